@@ -0,0 +1,371 @@
+//! @file
+//! @brief Benchmark suite - Source file.
+//! @author Mariusz Ornowski (mariusz.ornowski@ict-project.pl)
+//! @version 1.0
+//! @date 2016
+//! @copyright ICT-Project Mariusz Ornowski (ict-project.pl)
+/* **************************************************************
+Copyright (c) 2016, ICT-Project Mariusz Ornowski (ict-project.pl)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. Neither the name of the ICT-Project Mariusz Ornowski nor the names
+of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**************************************************************/
+//============================================
+#include "../src/global.hpp"
+#include "../src/os.hpp"
+#include "../src/dorothy.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+//============================================
+//target bench_dorothy
+//ldflags 
+//cppflags -std=c++11 
+//include ./src/global.cpp ./src/os.cpp ./src/dorothy.cpp
+//============================================
+namespace ict { namespace bench {
+//===========================================
+//! Korpus jednego kształtu: plik wejściowy oraz łączna liczba linii i bajtów wszystkich plików (każdy plik liczony raz).
+struct corpus_t {
+  std::string name;
+  std::string input;
+  std::size_t lines;
+  std::size_t bytes;
+  std::vector<std::string> files;
+};
+//! Wynik jednej fazy: najlepszy czas z powtórzeń, liczba węzłów (linii) i bajtów.
+struct result_t {
+  std::string shape;
+  std::string phase;
+  std::uint64_t ns;
+  std::size_t nodes;
+  std::size_t bytes;
+};
+struct options_t {
+  std::string dir;
+  unsigned int scale=1;
+  unsigned int runs=3;
+  bool json=false;
+  bool generate=false;
+  std::vector<std::string> shapes;
+};
+//! Strumień, który tylko liczy bajty i linie (serializacja bez kosztu zapisu).
+class CountBuf:public std::streambuf {
+public:
+  std::size_t bytes=0;
+  std::size_t lines=0;
+protected:
+  int_type overflow(int_type c){
+    if (c!=traits_type::eof()){
+      bytes++;
+      if (c=='\n') lines++;
+    }
+    return(traits_type::not_eof(c));
+  }
+  std::streamsize xsputn(const char * s,std::streamsize n){
+    bytes+=n;
+    for (std::streamsize i=0;i<n;i++) if (s[i]=='\n') lines++;
+    return(n);
+  }
+};
+//! Tokeny przekazywane do każdego kształtu ($1 ... $9).
+static ict::dorothy::tokens_t bench_tokens(){
+  ict::dorothy::tokens_t tokens;
+  for (unsigned int i=1;i<10;i++) tokens.set(i,"token-"+std::to_string(i)+" <&>");
+  return(tokens);
+}
+//===========================================
+static bool write_file(corpus_t & corpus,const std::string & path,const std::string & content){
+  std::ofstream ofs(path,std::ofstream::out|std::ofstream::binary);
+  ofs<<content;
+  ofs.close();
+  if (ofs.fail()){
+    std::cerr<<"ERROR: Can not write "<<path<<" !"<<std::endl;
+    return(false);
+  }
+  corpus.files.push_back(path);
+  corpus.bytes+=content.size();
+  for (const char c : content) if (c=='\n') corpus.lines++;
+  return(true);
+}
+//! Głębokie zagnieżdżenie - bloki po 100 poziomów.
+static std::string shape_deep(unsigned int scale){
+  std::string out("html\n");
+  for (unsigned int b=0;b<scale*50;b++) for (unsigned int d=1;d<=100;d++) {
+    out.append(d,' ');
+    out+="div.l"+std::to_string(d)+" level "+std::to_string(d)+"\n";
+  }
+  return(out);
+}
+//! Bardzo wiele rodzeństwa w jednym węźle.
+static std::string shape_wide(unsigned int scale){
+  std::string out("ul.list\n");
+  for (unsigned int i=0;i<scale*20000;i++) {
+    const std::string k(std::to_string(i));
+    out+=" li.item#i"+k+"(data-k="+k+") item "+k+"\n";
+  }
+  return(out);
+}
+//! Długie linie tekstu (znaki do zakodowania i znaki wielobajtowe UTF-8).
+static std::string shape_text(unsigned int scale){
+  std::string out("article\n");
+  std::string text;
+  while (text.size()<2000) text+="Lorem ipsum <b>dolor</b> & \"sit\" amet, zażółć gęślą jaźń ";
+  for (unsigned int i=0;i<scale*500;i++) {
+    out+=(i%2)?" p ":" - ";
+    out+=text+std::to_string(i)+"\n";
+  }
+  return(out);
+}
+//! Gęste użycie tokenów w tekście i atrybutach.
+static std::string shape_tokens(unsigned int scale){
+  std::string out("div.tokens\n");
+  for (unsigned int i=0;i<scale*10000;i++) out+=" span.t$1(title=\"$2 $3\",data-i="+std::to_string(i)+") $1 and $2, $3 $4 $5 $6 $7 $8 $9\n";
+  return(out);
+}
+//! Wiele par 'define' i 'clone'.
+static std::string shape_clones(unsigned int scale){
+  std::string out("div.clones\n");
+  const unsigned int n(scale*500);
+  for (unsigned int i=0;i<n;i++) {
+    const std::string k(std::to_string(i));
+    out+=" % define blk"+k+"\n  section.b"+k+"\n   h2 $1\n   p block "+k+" $2\n";
+  }
+  for (unsigned int i=0;i<n;i++) for (unsigned int j=0;j<4;j++) out+=" % clone blk"+std::to_string(i)+" \"v"+std::to_string(j)+"\" "+std::to_string(i*4+j)+"\n";
+  return(out);
+}
+//! Jeden plik dołączany wiele razy (fan-in).
+static bool shape_fanin(corpus_t & corpus,const std::string & dir,unsigned int scale){
+  std::string part,out("div.fanin\n");
+  for (unsigned int i=0;i<50;i++) part+="p.part"+std::to_string(i)+" part line "+std::to_string(i)+" $1\n";
+  if (!write_file(corpus,dir+"/fanin_part.dorothy",part)) return(false);
+  for (unsigned int i=0;i<scale*2000;i++) out+=" % include ./fanin_part \""+std::to_string(i)+"\"\n";
+  return(write_file(corpus,corpus.input,out));
+}
+//! Wiele różnych plików dołączanych raz (fan-out).
+static bool shape_fanout(corpus_t & corpus,const std::string & dir,unsigned int scale){
+  std::string out("div.fanout\n");
+  for (unsigned int f=0;f<scale*500;f++) {
+    const std::string k(std::to_string(f));
+    std::string part("section.f"+k+"\n");
+    for (unsigned int i=0;i<20;i++) part+=" p file "+k+" line "+std::to_string(i)+" $1\n";
+    if (!write_file(corpus,dir+"/fanout_"+k+".dorothy",part)) return(false);
+    out+=" % include ./fanout_"+k+" \""+k+"\"\n";
+  }
+  return(write_file(corpus,corpus.input,out));
+}
+static const std::vector<std::string> & all_shapes(){
+  static const std::vector<std::string> shapes({"deep","wide","text","tokens","clones","fanin","fanout"});
+  return(shapes);
+}
+//! Generator korpusu - zapisuje pliki kształtu w katalogu 'dir'.
+static bool generate(corpus_t & corpus,const std::string & dir,const std::string & shape,unsigned int scale){
+  corpus.name=shape;
+  corpus.input=dir+"/"+shape+".dorothy";
+  corpus.lines=corpus.bytes=0;
+  if (shape=="deep") return(write_file(corpus,corpus.input,shape_deep(scale)));
+  if (shape=="wide") return(write_file(corpus,corpus.input,shape_wide(scale)));
+  if (shape=="text") return(write_file(corpus,corpus.input,shape_text(scale)));
+  if (shape=="tokens") return(write_file(corpus,corpus.input,shape_tokens(scale)));
+  if (shape=="clones") return(write_file(corpus,corpus.input,shape_clones(scale)));
+  if (shape=="fanin") return(shape_fanin(corpus,dir,scale));
+  if (shape=="fanout") return(shape_fanout(corpus,dir,scale));
+  std::cerr<<"ERROR: Unknown shape: "<<shape<<std::endl;
+  return(false);
+}
+//===========================================
+static std::uint64_t now_ns(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+static void keep_best(std::uint64_t & best,std::uint64_t ns){
+  if ((!best)||(ns<best)) best=ns;
+}
+//! Mierzy fazy dla jednego kształtu: parse (źródła), link (obraz połączonego szablonu - --precompile), load (mapowanie obrazu), render (serializacja).
+static int measure(const options_t & options,const corpus_t & corpus,std::vector<result_t> & results){
+  const ict::dorothy::tokens_t tokens(bench_tokens());
+  const std::string image(corpus.input+"c");
+  std::uint64_t parse=0,link=0,load=0,render=0;
+  std::size_t imageBytes=0,outputBytes=0,outputLines=0;
+  for (unsigned int r=0;r<options.runs;r++){
+    {
+      ict::dorothy::Interface interface(false,10000,0,tokens);
+      std::ostringstream linked;
+      CountBuf counter;
+      std::ostream output(&counter);
+      std::uint64_t t;
+      interface.addInput(corpus.input);
+      t=now_ns();
+      if (interface.parse()) return(__LINE__);
+      keep_best(parse,now_ns()-t);
+      t=now_ns();
+      if (interface.precompile(linked)) return(__LINE__);
+      keep_best(link,now_ns()-t);
+      t=now_ns();
+      if (interface.serialize(output)) return(__LINE__);
+      keep_best(render,now_ns()-t);
+      outputBytes=counter.bytes;
+      outputLines=counter.lines;
+      if (!r) {
+        std::ofstream ofs(image,std::ofstream::out|std::ofstream::binary);
+        ofs<<linked.str();
+        if (!ofs.good()) return(__LINE__);
+        imageBytes=linked.str().size();
+      }
+    }
+    {
+      ict::dorothy::Interface interface(false,10000,0,tokens);
+      std::uint64_t t;
+      interface.addInput(image);
+      t=now_ns();
+      if (interface.parse()) return(__LINE__);
+      keep_best(load,now_ns()-t);
+    }
+  }
+  unlink(image.c_str());
+  results.push_back({corpus.name,"parse",parse,corpus.lines,corpus.bytes});
+  results.push_back({corpus.name,"link",link,corpus.lines,imageBytes});
+  results.push_back({corpus.name,"load",load,corpus.lines,imageBytes});
+  results.push_back({corpus.name,"render",render,outputLines,outputBytes});
+  return(0);
+}
+//! Wyniki w formacie 'klucz=wartość' (jedna linia na fazę) albo JSON - do porównania między wersjami.
+static void print(const options_t & options,const std::vector<result_t> & results){
+  const std::string version(
+  #ifdef GIT_VERSION
+    GIT_VERSION
+  #else
+    ""
+  #endif
+  );
+  if (options.json) std::cout<<"{\"version\":\""<<version<<"\",\"scale\":"<<options.scale<<",\"runs\":"<<options.runs<<",\"results\":["<<std::endl;
+  for (std::size_t i=0;i<results.size();i++){
+    const result_t & r(results[i]);
+    const double s(r.ns/1e9);
+    const double linesPerS(s?(r.nodes/s):0);
+    const double mbPerS(s?(r.bytes/s/1e6):0);
+    const double nsPerNode(r.nodes?(double(r.ns)/r.nodes):0);
+    if (options.json){
+      std::cout<<" {\"shape\":\""<<r.shape<<"\",\"phase\":\""<<r.phase<<"\",\"best_ns\":"<<r.ns<<",\"nodes\":"<<r.nodes<<",\"bytes\":"<<r.bytes;
+      std::cout<<",\"lines_per_s\":"<<linesPerS<<",\"mb_per_s\":"<<mbPerS<<",\"ns_per_node\":"<<nsPerNode<<"}"<<((i+1<results.size())?",":"")<<std::endl;
+    } else {
+      std::cout<<"version="<<version<<" scale="<<options.scale<<" runs="<<options.runs<<" shape="<<r.shape<<" phase="<<r.phase<<" best_ns="<<r.ns<<" nodes="<<r.nodes<<" bytes="<<r.bytes;
+      std::cout<<" lines_per_s="<<linesPerS<<" mb_per_s="<<mbPerS<<" ns_per_node="<<nsPerNode<<std::endl;
+    }
+  }
+  if (options.json) std::cout<<"]}"<<std::endl;
+}
+static int print_usage(){
+  std::cerr<<"Usage: "<<ict::global::arg[0]<<" [options] [shape ...]"<<std::endl;
+  std::cerr<<"Shapes: deep, wide, text, tokens, clones, fanin, fanout (default: all)."<<std::endl;
+  std::cerr<<"Options:"<<std::endl;
+  std::cerr<<" "<<"--corpus=<dir> - Corpus directory (default: temporary directory, removed at the end)."<<std::endl;
+  std::cerr<<" "<<"--generate - Only writes corpus (needs --corpus)."<<std::endl;
+  std::cerr<<" "<<"--scale=<value> - Corpus size multiplier (default: 1)."<<std::endl;
+  std::cerr<<" "<<"--runs=<value> - Number of runs, the best one is reported (default: 3)."<<std::endl;
+  std::cerr<<" "<<"--json - Results in JSON (default: one 'key=value' line per shape and phase)."<<std::endl;
+  std::cerr<<"Phases: parse (sources to trees), link (linked template image, as --precompile), load (image mapping), render (HTML)."<<std::endl;
+  return(1);
+}
+static int parse_options(options_t & options){
+  for (std::size_t i=1;i<ict::global::arg.size();i++){
+    const std::string & arg(ict::global::arg[i]);
+    try {
+      if (!arg.compare(0,9,"--corpus=")){
+        options.dir=arg.substr(9);
+      } else if (!arg.compare(0,8,"--scale=")){
+        options.scale=std::stoul(arg.substr(8));
+      } else if (!arg.compare(0,7,"--runs=")){
+        options.runs=std::stoul(arg.substr(7));
+      } else if (arg=="--json"){
+        options.json=true;
+      } else if (arg=="--generate"){
+        options.generate=true;
+      } else if ((arg.size()>1)&&(arg[0]=='-')){
+        return(print_usage());
+      } else {
+        options.shapes.push_back(arg);
+      }
+    } catch (...){
+      return(print_usage());
+    }
+  }
+  if ((!options.scale)||(!options.runs)||(options.generate&&(!options.dir.size()))) return(print_usage());
+  if (!options.shapes.size()) options.shapes=all_shapes();
+  return(0);
+}
+static int bench(){
+  options_t options;
+  std::vector<corpus_t> corpora;
+  std::vector<result_t> results;
+  bool temporary=false;
+  int out=parse_options(options);
+  if (out) return(out);
+  if (!options.dir.size()){
+    char dir[]="/tmp/bench_dorothy.XXXXXX";
+    if (!mkdtemp(dir)) return(__LINE__);
+    options.dir=dir;
+    temporary=true;
+  } else if (!ict::os::makeDir(options.dir)){
+    std::cerr<<"ERROR: Can not create "<<options.dir<<" !"<<std::endl;
+    return(__LINE__);
+  }
+  options.dir=ict::os::getRealPath(options.dir);
+  for (const std::string & shape : options.shapes){
+    corpus_t corpus;
+    if (!generate(corpus,options.dir,shape,options.scale)) {
+      out=__LINE__;
+      break;
+    }
+    corpora.push_back(corpus);
+  }
+  if ((!out)&&(!options.generate)) for (const corpus_t & corpus : corpora){
+    out=measure(options,corpus,results);
+    if (out) {
+      std::cerr<<"ERROR: Benchmark failed for shape "<<corpus.name<<" ("<<out<<")!"<<std::endl;
+      break;
+    }
+  }
+  if (temporary) {
+    for (const corpus_t & corpus : corpora) for (const std::string & path : corpus.files) unlink(path.c_str());
+    rmdir(options.dir.c_str());
+  }
+  if (out) return(out);
+  if (!options.generate) print(options,results);
+  return(0);
+}
+//===========================================
+}}
+//============================================
+int main(int argc, char **argv){
+  std::ios_base::sync_with_stdio(false);
+  return(ict::global::main(argc,argv,ict::bench::bench));
+}
+//===========================================
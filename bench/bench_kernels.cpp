@@ -0,0 +1,300 @@
+//! @file
+//! @brief Kernel microbenchmarks - Source file.
+//! @author Mariusz Ornowski (mariusz.ornowski@ict-project.pl)
+//! @version 1.0
+//! @date 2016
+//! @copyright ICT-Project Mariusz Ornowski (ict-project.pl)
+/* **************************************************************
+Copyright (c) 2016, ICT-Project Mariusz Ornowski (ict-project.pl)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. Neither the name of the ICT-Project Mariusz Ornowski nor the names
+of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**************************************************************/
+//============================================
+#include "../src/global.hpp"
+#include "../src/kernels.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+//============================================
+//target bench_kernels
+//ldflags 
+//cppflags -std=c++11 
+//include ./src/global.cpp ./src/os.cpp ./src/dorothy.cpp
+//============================================
+namespace ict { namespace bench {
+//===========================================
+//! Licznik alokacji (globalne operator new poniżej).
+static std::size_t allocations=0;
+//===========================================
+//! Przypadek wejściowy: nazwa i jedna linia tekstu, powielana do żądanej długości.
+struct input_t {
+  std::string name;
+  std::string sample;
+  std::string nameSample;
+};
+struct result_t {
+  std::string kernel;
+  std::string input;
+  std::size_t calls;
+  std::size_t bytes;
+  std::uint64_t ns;
+  std::size_t allocs;
+};
+struct options_t {
+  std::size_t size=256;
+  std::uint64_t time=200000000;
+  bool json=false;
+  std::vector<std::string> kernels;
+};
+//! Pomiar jednej partii wywołań: (wejście, liczba wywołań, wynik).
+typedef std::function<void(const std::string &,std::size_t,result_t &)> run_t;
+struct kernel_def_t {
+  std::string name;
+  bool useName;
+  run_t run;
+};
+//===========================================
+static const std::vector<input_t> & all_inputs(){
+  static const std::vector<input_t> inputs({
+    {"ascii","Lorem ipsum dolor sit amet $1, consectetur adipiscing elit $2 sed do eiusmod tempor. ","block-name"},
+    {"utf8","Zażółć gęślą jaźń $1 – 日本語のテキスト $2 Ελληνικά κείμενο ✓ ","blok-żółty-名前"},
+    {"escape","<a href=\"x\">&amp;</a> '$1' <b>&lt;$2&gt;</b> \"q\" & ","-a&b<c>\"d\""}
+  });
+  return(inputs);
+}
+static std::string repeat(const std::string & sample,std::size_t size){
+  std::string out(sample);
+  while (out.size()<size) out+=sample;
+  return(out);
+}
+static const ict::dorothy::tokens_t & kernel_tokens(){
+  static ict::dorothy::tokens_t tokens;
+  if (tokens.empty()) {
+    tokens.set(1,"token <one>");
+    tokens.set(2,"żółty & 名前");
+  }
+  return(tokens);
+}
+static const ict::dorothy::namespace_t & kernel_namespace(){
+  static const ict::dorothy::namespace_t namesp({"page","body","widget"});
+  return(namesp);
+}
+static std::uint64_t now_ns(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+//! Wywołuje 'kernel' dla każdego wejścia z 'inputs' (przygotowanych przed pomiarem, mogą zostać zużyte) - mierzy czas i alokacje.
+template<class I,class K> static void timed(std::vector<I> & inputs,std::size_t bytes,K kernel,result_t & out){
+  const std::size_t a(allocations);
+  const std::uint64_t t(now_ns());
+  for (I & input : inputs) kernel(input);
+  out.ns+=now_ns()-t;
+  out.allocs+=allocations-a;
+  out.calls+=inputs.size();
+  out.bytes+=inputs.size()*bytes;
+}
+template<class K> static run_t on_strings(K kernel){
+  return([kernel](const std::string & source,std::size_t batch,result_t & out){
+    std::vector<std::string> inputs(batch,source);
+    timed(inputs,source.size(),kernel,out);
+  });
+}
+static const std::vector<kernel_def_t> & all_kernels(){
+  static const std::vector<kernel_def_t> kernels({
+    {"encodeHtml",false,on_strings([](std::string & input){
+      std::string out(ict::dorothy::encodeHtml(input));
+    })},
+    {"replaceTokens",false,on_strings([](std::string & input){
+      std::string out(ict::dorothy::replaceTokens(input,kernel_tokens()));
+    })},
+    {"Names::fullName",true,on_strings([](std::string & input){
+      std::string out(ict::dorothy::kernels::fullName(kernel_namespace(),input));
+    })},
+    {"transferUTF(string,wstring)",false,on_strings([](std::string & input){
+      std::wstring out;
+      ict::global::transferUTF(input,out);
+    })},
+    {"transferUTF(wstring,string)",false,[](const std::string & source,std::size_t batch,result_t & out){
+      std::vector<std::wstring> inputs(batch);
+      for (std::wstring & w : inputs) {
+        std::string s(source);
+        ict::global::transferUTF(s,w);
+      }
+      timed(inputs,source.size(),[](std::wstring & input){
+        std::string out;
+        ict::global::transferUTF(input,out);
+      },out);
+    }},
+    {"base64Encode",false,on_strings([](std::string & input){
+      std::string out;
+      ict::global::base64Encode(input,out);
+    })},
+    {"base64Decode",false,[](const std::string & source,std::size_t batch,result_t & out){
+      std::string encoded;
+      ict::global::base64Encode(source,encoded);
+      std::vector<std::string> inputs(batch,encoded);
+      timed(inputs,encoded.size(),[](std::string & input){
+        std::string out;
+        ict::global::base64Decode(input,out);
+      },out);
+    }},
+    {"Files::getLine",false,[](const std::string & source,std::size_t batch,result_t & out){
+      std::string text;
+      for (std::size_t i=0;i<batch;i++) text+=source+"\n";
+      std::istringstream stream(text);
+      std::vector<std::string> lines(batch);
+      unsigned int lineCount=0;
+      timed(lines,source.size()+1,[&stream,&lineCount](std::string & line){
+        ict::dorothy::kernels::getLine(stream,lineCount,line);
+      },out);
+    }}
+  });
+  return(kernels);
+}
+//===========================================
+//! Pomiar jednego jądra: partie wywołań aż do upływu 'options.time'.
+static result_t measure(const options_t & options,const kernel_def_t & def,const input_t & input){
+  static const std::size_t batch=256;
+  const std::string source(def.useName?input.nameSample:repeat(input.sample,options.size));
+  result_t out{def.name,input.name,0,0,0,0};
+  while (out.ns<options.time) def.run(source,batch,out);
+  return(out);
+}
+//! Wyniki w formacie 'klucz=wartość' (jedna linia na jądro i wejście) albo JSON.
+static void print(const options_t & options,const std::vector<result_t> & results){
+  const std::string version(
+  #ifdef GIT_VERSION
+    GIT_VERSION
+  #else
+    ""
+  #endif
+  );
+  if (options.json) std::cout<<"{\"version\":\""<<version<<"\",\"size\":"<<options.size<<",\"results\":["<<std::endl;
+  for (std::size_t i=0;i<results.size();i++){
+    const result_t & r(results[i]);
+    const double bytesPerCall(double(r.bytes)/r.calls);
+    const double nsPerCall(double(r.ns)/r.calls);
+    const double nsPerByte(r.bytes?(double(r.ns)/r.bytes):0);
+    const double allocsPerCall(double(r.allocs)/r.calls);
+    if (options.json){
+      std::cout<<" {\"kernel\":\""<<r.kernel<<"\",\"input\":\""<<r.input<<"\",\"calls\":"<<r.calls<<",\"bytes_per_call\":"<<bytesPerCall;
+      std::cout<<",\"ns_per_call\":"<<nsPerCall<<",\"ns_per_byte\":"<<nsPerByte<<",\"allocs_per_call\":"<<allocsPerCall<<"}"<<((i+1<results.size())?",":"")<<std::endl;
+    } else {
+      std::cout<<"version="<<version<<" kernel="<<r.kernel<<" input="<<r.input<<" calls="<<r.calls<<" bytes_per_call="<<bytesPerCall;
+      std::cout<<" ns_per_call="<<nsPerCall<<" ns_per_byte="<<nsPerByte<<" allocs_per_call="<<allocsPerCall<<std::endl;
+    }
+  }
+  if (options.json) std::cout<<"]}"<<std::endl;
+}
+static int print_usage(){
+  std::cerr<<"Usage: "<<ict::global::arg[0]<<" [options] [kernel ...]"<<std::endl;
+  std::cerr<<"Kernels:";
+  for (const kernel_def_t & def : all_kernels()) std::cerr<<" "<<def.name;
+  std::cerr<<" (default: all)."<<std::endl;
+  std::cerr<<"Inputs: ascii, utf8 (mixed multi-byte), escape (escape-dense)."<<std::endl;
+  std::cerr<<"Options:"<<std::endl;
+  std::cerr<<" "<<"--size=<value> - Input size in bytes (default: 256; Names::fullName uses a short name)."<<std::endl;
+  std::cerr<<" "<<"--time=<value> - Measuring time per kernel and input in milliseconds (default: 200)."<<std::endl;
+  std::cerr<<" "<<"--json - Results in JSON (default: one 'key=value' line per kernel and input)."<<std::endl;
+  return(1);
+}
+static int parse_options(options_t & options){
+  for (std::size_t i=1;i<ict::global::arg.size();i++){
+    const std::string & arg(ict::global::arg[i]);
+    try {
+      if (!arg.compare(0,7,"--size=")){
+        options.size=std::stoul(arg.substr(7));
+      } else if (!arg.compare(0,7,"--time=")){
+        options.time=std::stoull(arg.substr(7))*1000000;
+      } else if (arg=="--json"){
+        options.json=true;
+      } else if ((arg.size()>1)&&(arg[0]=='-')&&(arg[1]=='-')){
+        return(print_usage());
+      } else {
+        options.kernels.push_back(arg);
+      }
+    } catch (...){
+      return(print_usage());
+    }
+  }
+  if ((!options.size)||(!options.time)) return(print_usage());
+  return(0);
+}
+static int bench(){
+  options_t options;
+  std::vector<result_t> results;
+  int out=parse_options(options);
+  if (out) return(out);
+  for (const std::string & name : options.kernels){
+    bool found=false;
+    for (const kernel_def_t & def : all_kernels()) if (def.name==name) found=true;
+    if (!found) {
+      std::cerr<<"ERROR: Unknown kernel: "<<name<<std::endl;
+      return(__LINE__);
+    }
+  }
+  for (const kernel_def_t & def : all_kernels()){
+    bool selected=!options.kernels.size();
+    for (const std::string & name : options.kernels) if (def.name==name) selected=true;
+    if (selected) for (const input_t & input : all_inputs()) results.push_back(measure(options,def,input));
+  }
+  print(options,results);
+  return(0);
+}
+//===========================================
+}}
+//============================================
+void * operator new(std::size_t size){
+  void * p=std::malloc(size?size:1);
+  if (!p) throw std::bad_alloc();
+  ict::bench::allocations++;
+  return(p);
+}
+void * operator new[](std::size_t size){
+  return(operator new(size));
+}
+void operator delete(void * p) noexcept {
+  std::free(p);
+}
+void operator delete[](void * p) noexcept {
+  std::free(p);
+}
+void operator delete(void * p,std::size_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void * p,std::size_t) noexcept {
+  std::free(p);
+}
+int main(int argc, char **argv){
+  std::ios_base::sync_with_stdio(false);
+  return(ict::global::main(argc,argv,ict::bench::bench));
+}
+//===========================================
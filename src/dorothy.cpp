@@ -35,10 +35,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 **************************************************************/
 //============================================
 #include "dorothy.hpp"
+#include "kernels.hpp"
 #include "global.hpp"
 #include "os.hpp"
-#include <regex>
 #include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
+#include <chrono>
+#include <iomanip>
 //============================================
 //target
 //ldflags 
@@ -51,62 +60,444 @@ namespace ict { namespace dorothy {
 #define LOG_INFO   2
 #define LOG_NOTICE 1
 //===========================================
-typedef std::vector<std::string> namespace_t;
-std::string encodeHtml(const std::string & input);
-std::string replaceTokens(const std::string & input,const tokens_t & tokens_in);
+//! Polityki serializacji - wybierane raz (na podstawie opcji) dla całego drzewa.
+template<bool indent_in,bool comments_in,bool debug_in,bool profile_in=false,bool measure_in=false> struct RenderPolicy {
+  //! Wcięcia na początku linii.
+  static const bool indent=indent_in;
+  //! Komentarze HTML (linie '/ ...').
+  static const bool comments=comments_in;
+  //! Komentarze diagnostyczne dla dyrektyw (-vvvv).
+  static const bool debug=debug_in;
+  //! Profil serializacji (--profile).
+  static const bool profile=profile_in;
+  //! Tylko rozmiar wyjścia (estymacja przed serializacją) - bez statystyk, śladu i punktów USDT.
+  static const bool measure=measure_in;
+};
+typedef RenderPolicy<false,false,false> RenderStrip;
+typedef RenderPolicy<true,true,false> RenderPretty;
+typedef RenderPolicy<true,true,true> RenderDebug;
+typedef RenderPolicy<false,false,false,true> RenderStripProfile;
+typedef RenderPolicy<true,true,false,true> RenderPrettyProfile;
+typedef RenderPolicy<true,true,true,true> RenderDebugProfile;
+typedef RenderPolicy<false,false,false,false,true> RenderStripMeasure;
+typedef RenderPolicy<true,true,false,false,true> RenderPrettyMeasure;
+typedef RenderPolicy<true,true,true,false,true> RenderDebugMeasure;
+//===========================================
+class Tree;
 //! Indeks plików.
 class Files {
 public:
   typedef unsigned int file_id_t;
   typedef unsigned int line_no_t;
-  struct file_struct_t {Line * line;std::string path;};
+  typedef std::shared_ptr<const Tree> tree_ptr_t;
+  typedef std::vector<file_id_t> file_list_t;
+  //! Plik: linia (tylko w czasie życia obiektu Interface), drzewo, stan pliku przy parsowaniu (mtime, size) i dołączane pliki.
+  //! Plik nieaktualny (stale) czeka na ponowne parsowanie z tym samym identyfikatorem.
+  //! Plik z pliku prekompilowanego (image - identyfikator pliku prekompilowanego) żyje tak długo jak ten plik i nie jest sprawdzany na dysku.
+  struct file_struct_t {Line * line;std::string path;tree_ptr_t tree;std::int64_t mtime;std::int64_t size;file_list_t includes;bool stale;file_id_t image;};
   typedef std::map<file_id_t,file_struct_t> file_map_t;
   typedef std::set<file_id_t> file_set_t;
 private:
   static file_map_t fileMap;
+  static file_map_t cacheMap;
+  static bool cache;
+  static void eraseIncluding(file_set_t & erased);
+  //! Usuwa pliki z plików prekompilowanych, które zostały usunięte lub unieważnione.
+  static void eraseImages();
 public:
   static Line * id2Line(file_id_t id);
   static std::string id2Path(file_id_t id);
+  static const Tree * id2Tree(file_id_t id);
+  static void setTree(file_id_t id,const tree_ptr_t & tree_in);
   static file_id_t path2id(const std::string & base_in,const std::string & path_in);
   static file_id_t path2id(const std::string & path_in);
   static bool erase(file_id_t id);
   static void add(file_id_t id_in,Line * line_in,const std::string & base_in,const std::string & path_in);
   static void add(file_id_t id_in,Line * line_in,const std::string & path_in);
+  //! Dodaje plik zapisany w pliku prekompilowanym 'image_in' (ścieżka - plik źródłowy, tylko do komunikatów).
+  static void addImage(file_id_t id_in,file_id_t image_in,const std::string & path_in,const tree_ptr_t & tree_in);
   static bool getLine(std::istream & input,line_no_t & lineCount,std::string & line);
+  static void setIncludes(file_id_t id,const file_list_t & includes_in);
+  static void includesAll(file_id_t id,file_list_t & list);
   static void clear(){fileMap.clear();}
+  //! Włącza pamięć podręczną - sparsowane pliki zostają w indeksie po zakończeniu pracy obiektu Interface.
+  //! Wyłączenie odkłada pamięć podręczną na bok (np. na czas listy zależności), ponowne włączenie ją przywraca.
+  static void setCache(bool cache_in);
+  //! Unieważnia plik - drzewo i nazwy pliku są usuwane, identyfikator zostaje (drzewa innych plików odwołują się do niego).
+  static void invalidate(file_id_t id);
+  static bool isStale(file_id_t id);
+  //! Unieważnia pliki zmienione na dysku (mtime, size), pliki usunięte są usuwane razem z plikami, które je dołączają.
+  static void validate();
+  //! Kończy pracę obiektu Interface - czyści indeks albo (z pamięcią podręczną) usuwa tylko pliki sparsowane z błędem.
+  static void release();
   static int dependences(const Options & options,std::ostream & output);
 };
+//!
+//! Zwarta reprezentacja jednego pliku (struct-of-arrays). 
+//! Węzeł to indeks w równoległych tablicach, rodzaj węzła wybiera sposób serializacji (bez metod wirtualnych).
+//! Węzeł 0 to plik (korzeń), dzieci są zapisane jako lista (firstChild, nextSibling).
+//!
+class Tree {
+public:
+  typedef std::uint32_t node_t;
+  typedef std::uint32_t index_t;
+  static const node_t none=0xFFFFFFFF;
+  enum kind_t {
+    kind_file=0,
+    kind_include,
+    kind_namespace,
+    kind_define,
+    kind_clone,
+    kind_text,
+    kind_html,
+    kind_comment,
+    kind_mock,
+    kind_node
+  };
+  enum flag_t {
+    flag_no_short=0x01,//Węzeł (tag) ma zawsze znacznik zamykający.
+    flag_root=0x02,//Przestrzeń nazw zaczyna się od korzenia.
+    flag_numeric=0x04,//Klonowanie dzieci dyrektywy 'include' lub 'clone' (numer zamiast nazwy).
+    flag_dynamic=0x08//Tokeny dyrektywy zawierają $N - ramka jest tworzona przy serializacji.
+  };
+  //! Kolumna drzewa - własny wektor (budowanie, pamięć podręczna) albo widok na zmapowany plik prekompilowany (.dorothyc).
+  //! Odczyt zawsze przez wskaźnik, więc zmapowane drzewo nie jest przepisywane węzeł po węźle.
+  template<class T> class Column {
+  private:
+    std::vector<T> owned;
+    const T * items;
+    std::size_t count;
+    void sync(){items=owned.data();count=owned.size();}
+  public:
+    Column():items(nullptr),count(0){}
+    Column(const Column &)=delete;
+    Column & operator=(const Column &)=delete;
+    std::size_t size() const {return(count);}
+    const T * data() const {return(items);}
+    const T & operator[](std::size_t i) const {return(items[i]);}
+    T & operator[](std::size_t i){return(owned[i]);}
+    void push_back(const T & value_in){owned.push_back(value_in);sync();}
+    void shrink_to_fit(){owned.shrink_to_fit();sync();}
+    void assign(std::vector<T> && values_in){owned.swap(values_in);sync();}
+    void map(const T * items_in,std::size_t count_in){owned.clear();items=items_in;count=count_in;}
+  };
+private:
+  Files::file_id_t fileId;
+  Column<std::uint8_t> kinds;
+  Column<std::uint8_t> flags;
+  Column<node_t> firstChild;
+  Column<node_t> nextSibling;
+  Column<Files::line_no_t> lineNos;
+  Column<depth_t> depths;
+  //! Początek danych węzła w tablicy 'data'.
+  Column<index_t> payload;
+  //! Dane węzłów (indeksy napisów, ramek, liczby) - układ zależy od rodzaju węzła.
+  Column<index_t> data;
+  //! Pula napisów - każdy napis jest zapisany raz (nazwy tagów, klas, atrybutów się powtarzają).
+  std::vector<std::string> strings;
+  std::vector<tokens_t> frames;
+  //! Zmapowany plik prekompilowany (kolumny wskazują na jego zawartość).
+  std::shared_ptr<const char> image;
+  //! Identyfikatory plików dla dyrektyw 'include' w pliku prekompilowanym (w drzewie są numery plików w obrazie).
+  std::shared_ptr<const std::vector<Files::file_id_t>> links;
+  //! Indeks puli napisów (tylko w trakcie budowania drzewa).
+  struct string_hash_t {
+    const std::vector<std::string> * pool;
+    std::size_t operator()(index_t i) const {return(std::hash<std::string>()((*pool)[i]));}
+  };
+  struct string_equal_t {
+    const std::vector<std::string> * pool;
+    bool operator()(index_t a,index_t b) const {return((*pool)[a]==(*pool)[b]);}
+  };
+  typedef std::unordered_set<index_t,string_hash_t,string_equal_t> string_index_t;
+  std::unique_ptr<string_index_t> stringIndex;
+  //! Sprawdza spójność drzewa wczytanego z pamięci podręcznej lub obrazu (indeksy węzłów, rodzaje, dane węzłów, napisy i ramki).
+  bool check() const;
+public:
+  Tree(Files::file_id_t fileId_in);
+  Files::file_id_t getFileId() const {return(fileId);}
+  std::size_t size() const {return(kinds.size());}
+  kind_t kind(node_t n) const {return((kind_t)kinds[n]);}
+  bool flag(node_t n,flag_t f) const {return(flags[n]&f);}
+  node_t first(node_t n) const {return(firstChild[n]);}
+  node_t next(node_t n) const {return(nextSibling[n]);}
+  Files::line_no_t lineNo(node_t n) const {return(lineNos[n]);}
+  depth_t depth(node_t n) const {return(depths[n]);}
+  index_t value(node_t n,index_t i) const {return(data[payload[n]+i]);}
+  const std::string & string(node_t n,index_t i) const {return(strings[data[payload[n]+i]]);}
+  const tokens_t & frame(node_t n,index_t i) const {return(frames[data[payload[n]+i]]);}
+  //! Plik dołączany przez dyrektywę 'include'.
+  Files::file_id_t link(node_t n) const {
+    const index_t i(value(n,1));
+    if (!links) return(i);
+    return((i<links->size())?(*links)[i]:Files::file_id_t(-1));
+  }
+  std::size_t childrenCount(node_t n) const;
+  node_t child(node_t n,std::size_t i) const;
+  std::ostream & log(node_t n,const std::string & level) const;
+  node_t add(kind_t kind_in,node_t parent_in,node_t previous_in,Files::line_no_t lineNo_in,depth_t depth_in);
+  void setFlag(node_t n,flag_t f){flags[n]|=f;}
+  void addValue(index_t value_in){data.push_back(value_in);}
+  void addString(const std::string & string_in);
+  void addFrame(const tokens_t & frame_in);
+  //! Kończy budowanie drzewa (zwalnia indeks puli napisów i nadmiar pamięci).
+  void finish();
+  //! Zmienia wartość węzła (identyfikator pliku dyrektywy 'include' po wczytaniu drzewa z pamięci podręcznej).
+  void setValue(node_t n,index_t i,index_t value_in){data[payload[n]+i]=value_in;}
+  //! Zapisuje drzewo (binarnie, bez identyfikatora pliku) - pamięć podręczna na dysku.
+  void save(std::string & output) const;
+  //! Wczytuje drzewo zapisane przez save() (fałsz - dane niepoprawne).
+  bool load(const std::string & input,std::size_t & pos);
+  //! Dopisuje drzewo do obrazu pliku prekompilowanego (dyrektywy 'include' dostają numery plików z 'index'), zwraca położenie opisu drzewa.
+  std::uint64_t saveImage(std::string & output,const std::map<Files::file_id_t,index_t> & index) const;
+  //! Mapuje drzewo z obrazu pliku prekompilowanego - kolumny wskazują na obraz, kopiowane są tylko pule napisów i ramek.
+  bool mapImage(const std::shared_ptr<const char> & image_in,std::size_t size,std::uint64_t offset,const std::shared_ptr<const std::vector<Files::file_id_t>> & links_in);
+};
 //! Indeks nazw.
 class Names {
 public:
-  struct name_struct_t {Line * line;Files::file_id_t file_id;Files::line_no_t line_no;};
+  struct name_struct_t {Files::file_id_t file_id;Tree::node_t node;Files::line_no_t line_no;};
   typedef std::map<std::string,name_struct_t> name_map_t;
 private:
   static name_map_t nameMap;
 public:
-  static Line * name2Line(const std::string & name);
+  static const Tree * name2Tree(const std::string & name);
+  static Tree::node_t name2Node(const std::string & name);
   static Files::file_id_t name2id(const std::string & name);
   static Files::line_no_t name2no(const std::string & name);
   static bool erase(const std::string & name);
-  static void add(const std::string & name,Line * line_in,Files::file_id_t file_id_in,Files::line_no_t line_no_in);
+  static void add(const std::string & name,Tree::node_t node_in,Files::file_id_t file_id_in,Files::line_no_t line_no_in);
   static std::string fullName(const namespace_t & namesp,const std::string & name);
+  //! Usuwa nazwy zdefiniowane w danym pliku.
+  static void eraseFile(Files::file_id_t file_id);
   static void clear(){nameMap.clear();}
+  //! Liczba nazw - w czasie serializacji nazwy są tylko dodawane, więc ta sama liczba oznacza te same nazwy.
+  static std::size_t size(){return(nameMap.size());}
+  //! Zapis i odtworzenie nazw (estymacja rozmiaru wyjścia rejestruje nazwy jak serializacja).
+  static const name_map_t & get(){return(nameMap);}
+  static void set(const name_map_t & nameMap_in){nameMap=nameMap_in;}
+};
+//! 
+//! Pamięć podręczna drzew na dysku (--cache-dir).
+//! Klucz to skrót zawartości pliku, wersji programu i opcji wpływających na parsowanie - zmiana ścieżki lub mtime nie unieważnia wpisu.
+//! Wpis to drzewo pliku oraz linie dyrektyw 'include' (są parsowane ponownie - dołączane pliki mają własne wpisy).
+//! Wpisy są zapisywane do pliku tymczasowego i przenoszone (rename), więc równoległe procesy widzą cały wpis albo żaden.
+//!
+class Cache {
+public:
+  struct include_t {std::string line;Files::line_no_t lineNo;Tree::node_t node;};
+  struct entry_t {depth_t maxDepth;std::vector<include_t> includes;};
+private:
+  static std::string dir;
+  static std::uint64_t maxSize;
+  static std::string header(const Options & options);
+public:
+  //! Wersja formatu wpisu (drzewa i listy dyrektyw 'include') - zmieniana razem z formatem.
+  static const std::uint32_t format=1;
+  static void setDir(const std::string & dir_in,std::uint64_t maxSize_in);
+  static bool enabled(){return(!dir.empty());}
+  //! Ścieżka wpisu dla podanej zawartości pliku.
+  static std::string path(const Options & options,const std::string & content);
+  static bool load(const Options & options,const std::string & path,Tree & tree,entry_t & entry);
+  static void store(const Options & options,const std::string & path,const Tree & tree,const entry_t & entry);
+};
+//! 
+//! Plik prekompilowany (--precompile, .dorothyc) - obraz połączonego szablonu: pliki (ścieżki źródłowe i drzewa), plik 0 to plik wejściowy.
+//! Obraz jest mapowany (mmap) i używany bez parsowania, drzewa wskazują na jego zawartość (Tree::mapImage()).
+//! Nazwy dla dyrektyw 'clone' zależą od tokenów i przestrzeni nazw, więc są wiązane przy serializacji (jak dla plików źródłowych).
+//!
+class Image {
+public:
+  //! Nagłówek obrazu (po nim tablica plików: położenie ścieżki i położenie drzewa).
+  struct header_t {char magic[8];std::uint32_t format;std::uint32_t order;std::uint32_t files;std::uint32_t reserved;std::uint64_t size;};
+  static const char magic[8];
+  static const std::uint32_t format=1;
+  static const std::uint32_t order=0x01020304;
+  static int save(Files::file_id_t root,std::ostream & output);
+  //! Mapuje obraz - plik 0 dostaje identyfikator 'root', pozostałe kolejne identyfikatory od 'fileCount'.
+  static bool load(const std::string & path,Files::file_id_t root,Files::file_id_t & fileCount);
+};
+//! 
+//! Statystyki (--stats). Czas jest mierzony w ramkach (stos): ramka pliku lub fazy obiektu Interface nie obejmuje ramek zagnieżdżonych.
+//! Zmiana fazy wewnątrz ramki czyta tylko zegar ścienny (co linię), zegar procesora jest czytany przy otwarciu i zamknięciu ramki.
+//!
+class Stats {
+public:
+  enum phase_t {
+    phase_read=0,
+    phase_lex,
+    phase_parse,
+    phase_link,
+    phase_render,
+    phase_estimate,
+    phase_count
+  };
+  //! Ramka pomiaru (RAII) - plik jest przypisywany do ramki przez file().
+  class Frame {
+  private:
+    bool active;
+  public:
+    Frame(phase_t phase_in);
+    ~Frame();
+  };
+private:
+  struct frame_t {phase_t phase;std::size_t file;std::uint64_t segment[phase_count];};
+  static const std::size_t none=std::size_t(-1);
+  static bool enabled;
+  static std::vector<frame_t> frames;
+  static std::uint64_t wallMark;
+  static std::uint64_t cpuMark;
+  static stats_t stats;
+  static time_stats_t phases[phase_count];
+  static std::uint64_t lines[Tree::kind_node+1];
+  static std::uint64_t wallClock();
+  static time_stats_t * fileTime(phase_t phase);
+  //! Dolicza czas od poprzedniego odczytu zegara do bieżącej ramki (cpu - także czas procesora, dzielony między fazy ramki).
+  static void tick(bool cpu);
+  static void change(phase_t phase_in);
+public:
+  static void setEnabled(bool enabled_in){enabled=enabled_in;}
+  static bool on(){return(enabled);}
+  //! Zeruje statystyki (nowy obiekt Interface).
+  static void reset();
+  static void phase(phase_t phase_in){if (enabled) change(phase_in);}
+  static phase_t current(){return(frames.size()?frames.back().phase:phase_link);}
+  //! Bieżąca ramka dotyczy pliku 'path' (parsowanego).
+  static void file(const std::string & path);
+  static void fileLines(std::uint64_t count){if (enabled&&frames.size()&&(frames.back().file!=none)) stats.files[frames.back().file].lines+=count;}
+  static void line(Tree::kind_t kind){if (enabled) lines[kind]++;}
+  static void include(){if (enabled) stats.includes++;}
+  static void clone(){if (enabled) stats.clones++;}
+  static void read(std::uint64_t bytes);
+  static void written(std::uint64_t bytes){if (enabled) stats.bytesWritten+=bytes;}
+  static void estimated(std::uint64_t bytes){if (enabled) stats.bytesEstimated+=bytes;}
+  static void get(stats_t & stats_out);
+};
+//! 
+//! Profil serializacji (--profile). Czas i bajty wyjścia węzła (bez dzieci) są przypisywane do linii źródła,
+//! a łącznie z dziećmi do bloków 'define' (pełna nazwa) i plików dyrektyw 'include' - sumy ze wszystkich rozwinięć.
+//! Kontekst (plik wejściowy, 'include', 'clone') tworzy też stos dla narzędzi flamegraph (format collapsed).
+//!
+class Profile {
+public:
+  enum kind_t {
+    kind_file=0,
+    kind_include,
+    kind_define
+  };
+  struct cost_t {std::uint64_t ns;std::uint64_t bytes;std::uint64_t count;};
+private:
+  typedef std::map<std::string,cost_t> cost_map_t;
+  //! Linia źródła - klucz (identyfikator pliku<<32)|numer linii.
+  typedef std::unordered_map<std::uint64_t,cost_t> line_map_t;
+  //! Kontekst - 'total' to koszt bloku 'define' lub pliku 'include' (tylko pierwsze wystąpienie nazwy na stosie - rekurencja nie jest liczona dwa razy),
+  //! 'lines' - linie w tym stosie.
+  struct context_t {kind_t kind;std::string name;std::string stack;cost_t * total;line_map_t * lines;};
+  static bool enabled;
+  static std::vector<context_t> contexts;
+  static std::map<std::string,std::size_t> active;
+  static cost_map_t defines;
+  static cost_map_t includes;
+  static std::map<std::string,line_map_t> stacks;
+  static line_map_t lines;
+  static std::map<Files::file_id_t,std::string> paths;
+  static const std::string & path(Files::file_id_t id);
+  static void top(std::ostream & output,const std::string & title,const std::vector<std::pair<std::string,cost_t>> & items,const cost_t & total,std::size_t count);
+public:
+  static void setEnabled(bool enabled_in){enabled=enabled_in;}
+  static bool on(){return(enabled);}
+  static void reset();
+  static std::uint64_t clock(){return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());}
+  static std::size_t depth(){return(contexts.size());}
+  //! Nowy kontekst - plik wejściowy lub plik dyrektywy 'include' (identyfikator), blok 'define' (pełna nazwa).
+  static void push(kind_t kind,Files::file_id_t id);
+  static void push(kind_t kind,const std::string & name);
+  static void pop();
+  //! Usuwa konteksty powyżej 'depth' (błąd serializacji).
+  static void truncate(std::size_t depth_in){while (contexts.size()>depth_in) pop();}
+  //! Koszt węzła w kontekstach [0,depth) - 'render' oznacza serializację węzła (nie zamknięcie).
+  static void add(std::size_t depth_in,const Tree & tree,Tree::node_t n,std::uint64_t ns,std::uint64_t bytes,bool render);
+  //! Raport: 'count' najdroższych bloków 'define', plików 'include', plików i linii.
+  static void report(std::ostream & output,std::size_t count);
+  //! Stosy w formacie collapsed (czas w ns) - np. flamegraph.pl.
+  static void collapsed(std::ostream & output);
+};
+//!
+//! Zdarzenia dla przeglądarki śladów (--trace, format Chrome trace-event) - odcinki czasu zagnieżdżone jak wywołania.
+//! Zdarzenie jest zapisywane przy otwarciu (kolejność według początku), czas trwania jest uzupełniany przy zamknięciu.
+//!
+class Trace {
+private:
+  struct event_t {const char * category;std::string name;std::uint64_t start;std::uint64_t duration;};
+  static bool enabled;
+  static std::vector<event_t> events;
+  //! Otwarte odcinki (indeksy w 'events').
+  static std::vector<std::size_t> open;
+  static void string(std::ostream & output,const std::string & in);
+public:
+  //! Odcinek do końca bloku (gdy ślad jest włączony).
+  class Span {
+  private:
+    bool active;
+  public:
+    Span(const char * category,const std::string & name):active(enabled){if (active) begin(category,name);}
+    ~Span(){if (active) end();}
+  };
+  static void setEnabled(bool enabled_in){enabled=enabled_in;}
+  static bool on(){return(enabled);}
+  static std::size_t depth(){return(open.size());}
+  static void begin(const char * category,const std::string & name);
+  static void end();
+  //! Zamyka odcinki powyżej 'depth' (błąd).
+  static void truncate(std::size_t depth_in){while (open.size()>depth_in) end();}
+  //! Zapisuje zdarzenia (obiekty JSON rozdzielone przecinkami, bez tablicy) z nazwą procesu i usuwa je.
+  static void write(std::ostream & output,long pid,const std::string & process);
+};
+//! Bufor liczący bajty przekazywane do innego bufora (statystyki, profil - tellp() zwraca liczbę bajtów).
+//! Bez bufora docelowego (nullptr) bajty są tylko liczone (estymacja rozmiaru wyjścia).
+class CountBuf:public std::streambuf {
+private:
+  std::streambuf * target;
+  std::uint64_t count;
+protected:
+  int_type overflow(int_type c);
+  std::streamsize xsputn(const char * s,std::streamsize n);
+  int sync(){return(target?target->pubsync():0);}
+  pos_type seekoff(off_type off,std::ios_base::seekdir dir,std::ios_base::openmode which);
+public:
+  CountBuf(std::streambuf * target_in):target(target_in),count(0){}
+  std::uint64_t size() const {return(count);}
+};
+//! Bufor dopisujący do napisu (wyjście w pamięci o rozmiarze zarezerwowanym z estymacji).
+class StringBuf:public std::streambuf {
+private:
+  std::string & target;
+protected:
+  int_type overflow(int_type c){
+    if (!traits_type::eq_int_type(c,traits_type::eof())) target+=traits_type::to_char_type(c);
+    return(traits_type::not_eof(c));
+  }
+  std::streamsize xsputn(const char * s,std::streamsize n){target.append(s,n);return(n);}
+public:
+  StringBuf(std::string & target_in):target(target_in){}
+};
+//! Bufor pliku źródłowego - uzupełnianie bufora to faza odczytu (statystyki), pozostały czas to analiza linii.
+class ReadBuf:public std::filebuf {
+protected:
+  int_type underflow();
+public:
+  //! Czy plik zaczyna się od podanych bajtów - porównanie z pierwszym wypełnieniem bufora (bez dodatkowego odczytu).
+  bool startsWith(const char * prefix,std::size_t size);
 };
 //! Obiekt obsługujący jedną linię (bazowy).
 class Line {
 public:
   typedef std::shared_ptr<Line> ptr_t;
   typedef std::vector<ptr_t> children_list_t;
-  struct local_context_t {
-    const namespace_t * namesp;
-    const tokens_t * tokens;
-    const line_list_t * lines;
-  };
 private:
   depth_t depth;
-  Line * parent;
+  //! Linie zachowane po parsowaniu (dyrektywy 'include' - lista zależności).
   children_list_t childrenList;
-  bool addParent(Line * ptr);
 protected:
   Files::file_id_t fileId;
   Files::line_no_t lineNo;
@@ -120,28 +511,24 @@ protected:
   bool testName(const std::string &name);
   Files::file_id_t getDepth() const {return(depth);}
   std::string getThisPath();
-  bool addChild(ptr_t & ptr);
-  void getChildren(line_list_t & lines);
+  Tree::node_t addNode(Tree & tree,Tree::kind_t kind,Tree::node_t parent,Tree::node_t previous) const;
   ptr_t factory(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1);
-  int parse(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount);
+  int parse(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount,Tree & tree,Tree::node_t root,Cache::entry_t * entry=nullptr);
+  //! Odtwarza linie dyrektyw 'include' z wpisu pamięci podręcznej (parsowanie dołączanych plików).
+  int restore(const Options & options,Tree & tree,const Cache::entry_t & entry);
+  int scan(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount);
+  void getIncludes(Files::file_list_t & includes) const;
 public:
   Line();
   Line(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1);
   virtual int parseLine(const Options & options)=0;
-  virtual int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  )=0;
-  virtual local_context_t * getLocalContext(){return(nullptr);}
-  int serializeLine(const Options & options,std::ostream & output);
-  int serializeChildren(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  //! Zapisuje linię w zwartym drzewie (zaraz po parsowaniu) - hierarchia klas służy tylko do parsowania.
+  virtual Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const=0;
+  //! Czy linia jest potrzebna po zapisaniu w drzewie (lista zależności).
+  virtual bool keep() const {return(false);}
+  //! Identyfikator pliku, do którego odnosi się linia (plik lub dyrektywa 'include').
+  virtual Files::file_id_t getLinkedId() const {return(-1);}
   virtual int dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last=false);
-  std::size_t childrenCount(){return(childrenList.size());}
   virtual ~Line(){};
 };
 //! Obiekt obsługujący jeden plik.
@@ -154,22 +541,20 @@ private:
 public:
   LineFile(const std::string & path_in);
   LineFile(const std::string & base_in,const std::string & path_in);
-  ~LineFile();
+  Files::file_id_t getLinkedId() const {return(linkedId);}
   int parseLine(const Options & options);
   int dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last=false);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //! Obiekt obsługujący linię z tokenami.
 class LineTokens:public Line {
 protected:
   tokens_t tokens;
+  bool tokensDynamic;
   int loadTokens(const Options & options);
+  void compileTokens(Tree & tree,Tree::node_t node) const;
 public:
-  LineTokens(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in){}
+  LineTokens(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in),tokensDynamic(false){}
 };
 //!
 //! Includes a file (identified by "path") into HTML file, 
@@ -178,19 +563,14 @@ public:
 //!
 class LineInclude:public LineTokens {
 private:
-  ptr_t includedFile;
-  local_context_t local_context;
+  std::shared_ptr<LineFile> includedFile;
 public:
-  LineInclude(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1)
-    :local_context({nullptr,nullptr,nullptr}),LineTokens(line_in,fileId_in,lineNo_in){}
+  LineInclude(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):LineTokens(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
   int dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last=false);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
-  local_context_t * getLocalContext(){return(&local_context);}
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
+  bool keep() const {return(true);}
+  Files::file_id_t getLinkedId() const {return(includedFile?includedFile->getLinkedId():-1);}
 };
 //!
 //! Defines namespace ("name") which is used for class names, 
@@ -205,11 +585,7 @@ private:
 public:
   LineNamespace(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):root_namespace(false),LineTokens(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Defines a block (identified by "name") which is not inserted into HTML file until 'clone' directive is used 
@@ -228,11 +604,7 @@ public:
     defCount--;
   }
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //! 
 //! Clones a block (identified by "name") into HTML file, 
@@ -241,18 +613,10 @@ public:
 //! Example: % clone name token1 "token2" - 
 //!
 class LineClone:public LineTokens {
-private:
-  local_context_t local_context;
 public:
-  LineClone(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1)
-    :local_context({nullptr,nullptr,nullptr}),LineTokens(line_in,fileId_in,lineNo_in){}
+  LineClone(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):LineTokens(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
-  local_context_t * getLocalContext(){return(&local_context);}
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Inserts text node ("any text") into HTML file (using HTML encoding);
@@ -264,11 +628,7 @@ private:
 public:
   LineText(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Inserts text ("any text") directly into HTML (without changes);
@@ -280,11 +640,7 @@ private:
 public:
   LineHtml(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Inserts comment node ("any text") into HTML file (without changes);
@@ -296,11 +652,7 @@ private:
 public:
   LineComment(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Comment (not inserted into HTML file);
@@ -310,11 +662,7 @@ class LineMock:public Line {
 public:
   LineMock(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):Line(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //!
 //! Inserts node ("tag") with class names ("class1 class2" - if name starts with "-" then root namespace is used), 
@@ -332,8 +680,28 @@ private:
     stage_attr_name,
     stage_attr_value,
     stage_space,
-    stage_text
+    stage_text,
+    stage_count
+  };
+  //! Klasy znaków (bajtów UTF-8) rozróżniane przez automat.
+  enum char_class_t {
+    char_other=0,
+    char_blank,
+    char_nul,
+    char_tilde,
+    char_dot,
+    char_hash,
+    char_open,
+    char_close,
+    char_equal,
+    char_comma,
+    char_quote,
+    char_escape,
+    char_class_count
   };
+  static const std::uint8_t charClass[256];
+  //! Przejścia na znakach sterujących (stage_start - znak nie jest sterujący).
+  static const std::uint8_t ctrlTable[stage_count][char_class_count];
   typedef std::vector<std::string> class_names_t;
   typedef std::map<std::string,std::string> attr_t;
   std::string tag;
@@ -342,20 +710,44 @@ private:
   attr_t attr;
   std::string textLine;
   bool no_short;
-  stage_t ctrlChar(stage_t stage, wchar_t c);
-  int loadAll(const Options & options);
+  int loadAll();
   void saveToken(stage_t stage,const std::string & token, std::string & attrName);
-  std::string getAttr(const namespace_t & namesp_in,const tokens_t & tokens_in);
 public:
   LineNode(const std::string & line_in,Files::file_id_t fileId_in=-1,Files::line_no_t lineNo_in=-1):no_short(false),Line(line_in,fileId_in,lineNo_in){}
   int parseLine(const Options & options);
-  int serialize(
-    const Options & options,std::ostream & output,
-    const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-    depth_t depth_in,depth_t comments_in
-  );
+  Tree::node_t compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const;
 };
 //===========================================
+const Tokens::index_t Tokens::maxSize;
+const std::string Tokens::emptyValue;
+Tokens::Tokens(index_t capacity_in):slots(new slots_t()){
+  slots->reserve((capacity_in<maxSize)?capacity_in:maxSize);
+}
+Tokens::slots_t & Tokens::write(){
+  if (!slots){
+    slots.reset(new slots_t());
+  } else if (!slots.unique()){
+    slots.reset(new slots_t(*slots));
+  }
+  return(*slots);
+}
+bool Tokens::set(index_t i,const std::string & value_in){
+  if (i>=maxSize) return(false);
+  slots_t & s(write());
+  if (i>=s.size()) s.resize(i+1,slot_t{std::string(),false});
+  s[i].value=value_in;
+  s[i].set=true;
+  return(true);
+}
+bool Tokens::set(index_t i,std::string && value_in){
+  if (i>=maxSize) return(false);
+  slots_t & s(write());
+  if (i>=s.size()) s.resize(i+1,slot_t{std::string(),false});
+  s[i].value=std::move(value_in);
+  s[i].set=true;
+  return(true);
+}
+//===========================================
 std::string encodeHtml(const std::string & input){
   std::string sinput(input);
   std::wstring winput;
@@ -387,6 +779,43 @@ std::string encodeHtml(const std::string & input){
   ict::global::transferUTF(woutput,soutput);
   return(soutput);
 }
+//! Liczba bajtów znaku po encodeHtml() (html) lub bez kodowania.
+static std::size_t charSize(char c,bool html){
+  if (html) switch (c){
+    case '&':return(5);
+    case '<':case '>':return(4);
+    case '"':case '\'':return(6);
+    default:break;
+  }
+  return(1);
+}
+//! Długość encodeHtml(replaceTokens()) (html) lub replaceTokens() bez tworzenia napisów - estymacja rozmiaru wyjścia (dokładna dla UTF-8).
+static std::size_t tokensSize(const std::string & input,const tokens_t & tokens_in,bool html){
+  std::size_t out=0;
+  for (std::size_t i=0;i<input.size();i++){
+    if (input[i]=='$'){
+      std::size_t j=i+1;
+      std::uint64_t k=0;
+      bool valid=true;
+      for (;(j<input.size())&&(input[j]>='0')&&(input[j]<='9');j++){//Jak std::stoull - przepełnienie daje token 0.
+        const std::uint64_t d(input[j]-'0');
+        if (k>((std::uint64_t(-1)-d)/10)) valid=false;
+        k=k*10+d;
+      }
+      if (j==(i+1)) {
+        out++;//Sam znak '$'.
+      } else {
+        for (const char c : tokens_in.get(valid?k:0)) out+=charSize(c,html);
+      }
+      //Znak kończący token jest zapisywany, chyba że to '$' (znak '\0' jest pomijany jak w replaceTokens()).
+      i=j;
+      if ((i<input.size())&&input[i]&&(input[i]!='$')) out+=charSize(input[i],html);
+    } else if (input[i]) {
+      out+=charSize(input[i],html);
+    }
+  }
+  return(out);
+}
 std::string replaceTokens(const std::string & input,const tokens_t & tokens_in){
   std::string sinput(input);
   std::wstring winput;
@@ -411,8 +840,9 @@ std::string replaceTokens(const std::string & input,const tokens_t & tokens_in){
             }catch(...){
               k=0;
             }
-            if (tokens_in.count(k)){
-              std::string stoken(tokens_in.at(k));
+            const std::string & value(tokens_in.get(k));
+            if (value.size()){
+              std::string stoken(value);
               std::wstring wtoken;
               ict::global::transferUTF(stoken,wtoken);
               woutput+=wtoken;
@@ -446,10 +876,17 @@ std::string Files::id2Path(file_id_t id){
   if (fileMap.count(id)) return(fileMap.at(id).path);
   return("");
 }
+const Tree * Files::id2Tree(file_id_t id){
+  if (fileMap.count(id)) return(fileMap.at(id).tree.get());
+  return(nullptr);
+}
+void Files::setTree(file_id_t id,const tree_ptr_t & tree_in){
+  if (fileMap.count(id)) fileMap.at(id).tree=tree_in;
+}
 Files::file_id_t Files::path2id(const std::string & base_in,const std::string & path_in){
   std::string path(ict::os::getRealPath(base_in,path_in));
   for (file_map_t::const_iterator it=fileMap.cbegin();it!=fileMap.cend();++it){
-    if (it->second.path==path) return(it->first);
+    if ((it->second.path==path)&&(it->second.image==file_id_t(-1))) return(it->first);
   }
   return(-1);
 }
@@ -464,31 +901,146 @@ bool Files::erase(file_id_t id){
   return(false);
 }
 void Files::add(file_id_t id_in,Line * line_in,const std::string & base_in,const std::string & path_in){
-  fileMap[id_in].line=line_in;
-  fileMap[id_in].path=ict::os::getRealPath(base_in,path_in);
+  file_struct_t & f(fileMap[id_in]);
+  f.line=line_in;
+  f.path=ict::os::getRealPath(base_in,path_in);
+  f.stale=false;
+  f.image=-1;
+  if (!ict::os::getFileStamp(f.path,f.mtime,f.size)) f.mtime=f.size=-1;
+}
+void Files::addImage(file_id_t id_in,file_id_t image_in,const std::string & path_in,const tree_ptr_t & tree_in){
+  file_struct_t & f(fileMap[id_in]);
+  f.line=nullptr;
+  f.path=path_in;
+  f.tree=tree_in;
+  f.mtime=f.size=-1;
+  f.includes.clear();
+  f.stale=false;
+  f.image=image_in;
 }
 void Files::add(file_id_t id_in,Line * line_in,const std::string & path_in){
   add(id_in,line_in,"-",path_in);
 }
+void Files::setIncludes(file_id_t id,const file_list_t & includes_in){
+  if (fileMap.count(id)) fileMap.at(id).includes=includes_in;
+}
+void Files::includesAll(file_id_t id,file_list_t & list){
+  file_set_t visited;
+  file_list_t stack(1,id);
+  while (stack.size()){
+    file_id_t i(stack.back());
+    stack.pop_back();
+    if (visited.count(i)||!fileMap.count(i)) continue;
+    visited.insert(i);
+    list.push_back(i);
+    const file_list_t & includes(fileMap.at(i).includes);
+    for (file_list_t::const_reverse_iterator it=includes.crbegin();it!=includes.crend();++it) stack.push_back(*it);
+  }
+}
+Files::file_map_t Files::cacheMap;
+bool Files::cache=false;
+void Files::setCache(bool cache_in){
+  if (cache==cache_in) return;
+  cache=cache_in;
+  fileMap.swap(cacheMap);
+  if (cache) cacheMap.clear();
+}
+void Files::eraseIncluding(file_set_t & erased){
+  for (bool changed=erased.size();changed;){
+    changed=false;
+    for (file_map_t::iterator it=fileMap.begin();it!=fileMap.end();){
+      bool found=false;
+      for (file_id_t i : it->second.includes) if (erased.count(i)) found=true;
+      if (found) {
+        erased.insert(it->first);
+        it=fileMap.erase(it);
+        changed=true;
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+void Files::eraseImages(){
+  for (file_map_t::iterator it=fileMap.begin();it!=fileMap.end();){
+    const file_id_t image(it->second.image);
+    if ((image!=file_id_t(-1))&&((!fileMap.count(image))||(!fileMap.at(image).tree))) {
+      Names::eraseFile(it->first);
+      it=fileMap.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+void Files::invalidate(file_id_t id){
+  if (fileMap.count(id)) {
+    file_struct_t & f(fileMap.at(id));
+    f.tree.reset();
+    f.includes.clear();
+    f.stale=true;
+    Names::eraseFile(id);
+  }
+}
+bool Files::isStale(file_id_t id){
+  return(fileMap.count(id)&&fileMap.at(id).stale);
+}
+void Files::validate(){
+  file_set_t erased;
+  if (!cache) return;
+  for (file_map_t::iterator it=fileMap.begin();it!=fileMap.end();){
+    std::int64_t mtime,size;
+    if (it->second.image!=file_id_t(-1)) {
+      ++it;
+    } else if (!ict::os::getFileStamp(it->second.path,mtime,size)){
+      erased.insert(it->first);
+      it=fileMap.erase(it);
+    } else {
+      if ((mtime!=it->second.mtime)||(size!=it->second.size)) invalidate(it->first);
+      ++it;
+    }
+  }
+  eraseIncluding(erased);
+  eraseImages();
+}
+void Files::release(){
+  file_set_t erased;
+  if (!cache) {
+    clear();
+    return;
+  }
+  for (file_map_t::iterator it=fileMap.begin();it!=fileMap.end();){
+    it->second.line=nullptr;
+    if (it->second.tree) {
+      ++it;
+    } else {
+      erased.insert(it->first);
+      it=fileMap.erase(it);
+    }
+  }
+  eraseIncluding(erased);
+  eraseImages();
+}
 bool Files::getLine(std::istream & input,line_no_t & lineCount,std::string & soutput){
   std::string sinput;
-  std::wstring winput;
-  std::wstring woutput;
   soutput.clear();
   for (;input.good();) {
     std::getline(input,sinput);
-    ict::global::transferUTF(sinput,winput);
     lineCount++;
-    if (winput.back()==L'\\'){
-      winput.resize(winput.size()-1);
-      woutput+=winput;
-      winput.clear();
+    for (const char c : sinput) if (c&0x80) {//Poza ASCII - linia przechodzi przez UTF-32 (jak dotąd, także dla błędnych sekwencji).
+      std::wstring winput;
+      ict::global::transferUTF(sinput,winput);
+      sinput.clear();
+      ict::global::transferUTF(winput,sinput);
+      break;
+    }
+    if (sinput.size()&&(sinput.back()=='\\')){
+      sinput.resize(sinput.size()-1);
+      soutput+=sinput;
     } else {
-      woutput+=winput;
-      for (wchar_t c : woutput) switch (c){
-      case L' ':case L'\t':break;
+      soutput+=sinput;
+      for (const char c : soutput) switch (c){
+      case ' ':case '\t':break;
       default:
-        ict::global::transferUTF(woutput,soutput);
         return(true);
       }
       return(false);
@@ -507,12 +1059,340 @@ int Files::dependences(const Options & options,std::ostream & output){
   return(0);
 }
 
+//===========================================
+const Tree::node_t Tree::none;
+Tree::Tree(Files::file_id_t fileId_in):fileId(fileId_in),
+  stringIndex(new string_index_t(64,string_hash_t{&strings},string_equal_t{&strings})){
+}
+std::size_t Tree::childrenCount(node_t n) const {
+  std::size_t out=0;
+  for (node_t c=firstChild[n];c!=none;c=nextSibling[c]) out++;
+  return(out);
+}
+Tree::node_t Tree::child(node_t n,std::size_t i) const {
+  node_t c=firstChild[n];
+  for (;(c!=none)&&i;c=nextSibling[c]) i--;
+  return(c);
+}
+std::ostream & Tree::log(node_t n,const std::string & level) const {
+  Files::line_no_t l((lineNos[n]==Files::line_no_t(-1))?0:lineNos[n]);
+  depth_t d((depths[n]==depth_t(-1))?0:depths[n]);
+  std::cerr<<ict::os::getRelativePath(Files::id2Path(fileId));
+  std::cerr<<":"<<l;
+  std::cerr<<":"<<d;
+  std::cerr<<": "<<level<<" : ";
+  return(std::cerr);
+}
+Tree::node_t Tree::add(kind_t kind_in,node_t parent_in,node_t previous_in,Files::line_no_t lineNo_in,depth_t depth_in){
+  node_t n(kinds.size());
+  kinds.push_back(kind_in);
+  flags.push_back(0);
+  firstChild.push_back(none);
+  nextSibling.push_back(none);
+  lineNos.push_back(lineNo_in);
+  depths.push_back(depth_in);
+  payload.push_back(data.size());
+  if (previous_in!=none){
+    nextSibling[previous_in]=n;
+  } else if (parent_in!=none){
+    firstChild[parent_in]=n;
+  }
+  return(n);
+}
+void Tree::addString(const std::string & string_in){
+  index_t i(strings.size());
+  strings.push_back(string_in);
+  if (stringIndex){
+    std::pair<string_index_t::iterator,bool> r(stringIndex->insert(i));
+    if (!r.second){//Napis jest już w puli.
+      strings.pop_back();
+      i=*r.first;
+    }
+  }
+  data.push_back(i);
+}
+void Tree::addFrame(const tokens_t & frame_in){
+  data.push_back(frames.size());
+  frames.push_back(frame_in);
+}
+//! Zapis binarny (pamięć podręczna na dysku) - format lokalny dla maszyny (kolejność bajtów, rozmiary typów).
+template<class T> static void saveValue(std::string & output,const T & value){
+  output.append((const char*)&value,sizeof(T));
+}
+static void saveString(std::string & output,const std::string & value){
+  saveValue<std::uint32_t>(output,value.size());
+  output.append(value);
+}
+template<class C> static void saveVector(std::string & output,const C & value){
+  saveValue<std::uint32_t>(output,value.size());
+  output.append((const char*)value.data(),value.size()*sizeof(*value.data()));
+}
+template<class T> static bool loadValue(const std::string & input,std::size_t & pos,T & value){
+  if ((input.size()-pos)<sizeof(T)) return(false);
+  input.copy((char*)&value,sizeof(T),pos);
+  pos+=sizeof(T);
+  return(true);
+}
+static bool loadString(const std::string & input,std::size_t & pos,std::string & value){
+  std::uint32_t size;
+  if (!loadValue(input,pos,size)) return(false);
+  if ((input.size()-pos)<size) return(false);
+  value.assign(input,pos,size);
+  pos+=size;
+  return(true);
+}
+template<class T> static bool loadVector(const std::string & input,std::size_t & pos,std::vector<T> & value){
+  std::uint32_t size;
+  if (!loadValue(input,pos,size)) return(false);
+  if (((input.size()-pos)/sizeof(T))<size) return(false);
+  value.resize(size);
+  input.copy((char*)value.data(),size*sizeof(T),pos);
+  pos+=size*sizeof(T);
+  return(true);
+}
+template<class T> static bool loadVector(const std::string & input,std::size_t & pos,Tree::Column<T> & value){
+  std::vector<T> values;
+  if (!loadVector(input,pos,values)) return(false);
+  value.assign(std::move(values));
+  return(true);
+}
+void Tree::save(std::string & output) const {
+  saveVector(output,kinds);
+  saveVector(output,flags);
+  saveVector(output,firstChild);
+  saveVector(output,nextSibling);
+  saveVector(output,lineNos);
+  saveVector(output,depths);
+  saveVector(output,payload);
+  saveVector(output,data);
+  saveValue<std::uint32_t>(output,strings.size());
+  for (const std::string & s : strings) saveString(output,s);
+  saveValue<std::uint32_t>(output,frames.size());
+  for (const tokens_t & f : frames) {
+    saveValue<std::uint32_t>(output,f.size());
+    for (tokens_t::index_t i=0;i<f.size();i++) {
+      saveValue<std::uint8_t>(output,f.has(i));
+      if (f.has(i)) saveString(output,f.get(i));
+    }
+  }
+}
+bool Tree::load(const std::string & input,std::size_t & pos){
+  std::uint32_t count;
+  stringIndex.reset();
+  if (!loadVector(input,pos,kinds)) return(false);
+  if (!loadVector(input,pos,flags)) return(false);
+  if (!loadVector(input,pos,firstChild)) return(false);
+  if (!loadVector(input,pos,nextSibling)) return(false);
+  if (!loadVector(input,pos,lineNos)) return(false);
+  if (!loadVector(input,pos,depths)) return(false);
+  if (!loadVector(input,pos,payload)) return(false);
+  if (!loadVector(input,pos,data)) return(false);
+  if (!loadValue(input,pos,count)) return(false);
+  strings.resize(count);
+  for (std::string & s : strings) if (!loadString(input,pos,s)) return(false);
+  if (!loadValue(input,pos,count)) return(false);
+  frames.resize(count);
+  for (tokens_t & f : frames) {
+    std::uint32_t size;
+    if (!loadValue(input,pos,size)) return(false);
+    if (size>tokens_t::maxSize) return(false);
+    f=tokens_t(size);
+    for (tokens_t::index_t i=0;i<size;i++) {
+      std::uint8_t set;
+      std::string value;
+      if (!loadValue(input,pos,set)) return(false);
+      if (set&&(!loadString(input,pos,value)||!f.set(i,std::move(value)))) return(false);
+    }
+  }
+  return(check());
+}
+bool Tree::check() const {
+  const std::size_t n(kinds.size());
+  if ((flags.size()!=n)||(firstChild.size()!=n)||(nextSibling.size()!=n)||(lineNos.size()!=n)||(depths.size()!=n)||(payload.size()!=n)) return(false);
+  if ((!n)||(kinds[0]!=kind_file)) return(false);
+  for (std::size_t k=0;k<n;k++){
+    std::size_t size(0);//Liczba danych węzła.
+    std::size_t first(0);//Pierwszy indeks napisu w danych węzła (kolejne dane do 'size' to też napisy).
+    bool frame(false);//Pierwsza dana to indeks ramki.
+    //Węzły są dodawane w kolejności parsowania - dziecko i następnik mają większy indeks (bez cykli).
+    if ((firstChild[k]!=none)&&((firstChild[k]<=k)||(firstChild[k]>=n))) return(false);
+    if ((nextSibling[k]!=none)&&((nextSibling[k]<=k)||(nextSibling[k]>=n))) return(false);
+    if (payload[k]>data.size()) return(false);
+    const std::size_t p(payload[k]);
+    const std::size_t left(data.size()-p);
+    switch (kinds[k]){
+      case kind_file:case kind_mock:break;
+      case kind_include:case kind_clone://Ramka tokenów i plik (numer dziecka).
+        size=2;
+        first=2;
+        frame=true;
+        break;
+      case kind_namespace:case kind_define://Liczba nazw i nazwy.
+        if (left<1) return(false);
+        size=1+std::size_t(data[p]);
+        first=1;
+        break;
+      case kind_text:case kind_html:case kind_comment:
+        size=1;
+        break;
+      case kind_node://Liczby klas i atrybutów, tag, tekst, id, klasy, pary atrybutów.
+        if (left<2) return(false);
+        size=5+std::size_t(data[p])+2*std::size_t(data[p+1]);
+        first=2;
+        break;
+      default:return(false);
+    }
+    if (size>left) return(false);
+    if (frame&&(data[p]>=frames.size())) return(false);
+    for (std::size_t i=first;i<size;i++) if (data[p+i]>=strings.size()) return(false);
+  }
+  return(true);
+}
+//! Obraz pliku prekompilowanego - położenia są liczone od początku pliku, sekcje są wyrównane do 8 bajtów.
+static void alignImage(std::string & output){
+  output.append((8-output.size()%8)%8,'\0');
+}
+//! Napis w obrazie: długość (32 bity) i bajty.
+static std::uint64_t saveImageString(std::string & output,const std::string & value){
+  std::uint64_t offset;
+  alignImage(output);
+  offset=output.size();
+  saveValue<std::uint32_t>(output,value.size());
+  output.append(value);
+  return(offset);
+}
+template<class C> static std::uint64_t saveImageArray(std::string & output,const C & value){
+  std::uint64_t offset;
+  alignImage(output);
+  offset=output.size();
+  output.append((const char*)value.data(),value.size()*sizeof(*value.data()));
+  return(offset);
+}
+//! Opis drzewa w obrazie: liczby węzłów, danych, napisów i ramek oraz położenia sekcji.
+struct image_tree_t {
+  std::uint32_t nodes,data,strings,frames;
+  std::uint64_t kinds,flags,firstChild,nextSibling,lineNos,depths,payload,values,stringTable,frameTable;
+};
+std::uint64_t Tree::saveImage(std::string & output,const std::map<Files::file_id_t,index_t> & index) const {
+  image_tree_t t;
+  std::uint64_t offset;
+  std::vector<index_t> values(data.data(),data.data()+data.size());
+  std::vector<std::uint64_t> table;
+  for (node_t n=0;n<size();n++) if (kind(n)==kind_include) {
+    std::map<Files::file_id_t,index_t>::const_iterator it(index.find(value(n,1)));
+    values[payload[n]+1]=(it==index.end())?none:it->second;
+  }
+  alignImage(output);
+  offset=output.size();
+  output.append(sizeof(t),'\0');
+  t.nodes=size();
+  t.data=values.size();
+  t.strings=strings.size();
+  t.frames=frames.size();
+  t.kinds=saveImageArray(output,kinds);
+  t.flags=saveImageArray(output,flags);
+  t.firstChild=saveImageArray(output,firstChild);
+  t.nextSibling=saveImageArray(output,nextSibling);
+  t.lineNos=saveImageArray(output,lineNos);
+  t.depths=saveImageArray(output,depths);
+  t.payload=saveImageArray(output,payload);
+  t.values=saveImageArray(output,values);
+  for (const std::string & s : strings) table.push_back(saveImageString(output,s));
+  t.stringTable=saveImageArray(output,table);
+  table.clear();
+  for (const tokens_t & f : frames) {//Ramka: liczba pozycji i położenia napisów (0 - pozycja pusta).
+    std::vector<std::uint64_t> slots;
+    slots.push_back(f.size());
+    for (tokens_t::index_t i=0;i<f.size();i++) slots.push_back(f.has(i)?saveImageString(output,f.get(i)):0);
+    table.push_back(saveImageArray(output,slots));
+  }
+  t.frameTable=saveImageArray(output,table);
+  output.replace(offset,sizeof(t),(const char*)&t,sizeof(t));
+  return(offset);
+}
+//! Sprawdza, czy sekcja obrazu mieści się w pliku i jest wyrównana.
+static bool testImage(std::size_t size,std::uint64_t offset,std::uint64_t count,std::size_t item){
+  return((offset%8==0)&&(offset<=size)&&(count<=(size-offset)/item));
+}
+static bool loadImageString(const char * image,std::size_t size,std::uint64_t offset,std::string & value){
+  std::uint32_t length;
+  if (!testImage(size,offset,1,sizeof(length))) return(false);
+  std::memcpy(&length,image+offset,sizeof(length));
+  if ((size-offset-sizeof(length))<length) return(false);
+  value.assign(image+offset+sizeof(length),length);
+  return(true);
+}
+template<class T> static bool mapImageArray(const char * image,std::size_t size,std::uint64_t offset,std::uint64_t count,Tree::Column<T> & value){
+  if (!testImage(size,offset,count,sizeof(T))) return(false);
+  value.map((const T*)(image+offset),count);
+  return(true);
+}
+bool Tree::mapImage(const std::shared_ptr<const char> & image_in,std::size_t size,std::uint64_t offset,const std::shared_ptr<const std::vector<Files::file_id_t>> & links_in){
+  const char * p(image_in.get());
+  image_tree_t t;
+  if (!testImage(size,offset,1,sizeof(t))) return(false);
+  std::memcpy(&t,p+offset,sizeof(t));
+  if (!t.nodes) return(false);
+  if (!mapImageArray(p,size,t.kinds,t.nodes,kinds)) return(false);
+  if (!mapImageArray(p,size,t.flags,t.nodes,flags)) return(false);
+  if (!mapImageArray(p,size,t.firstChild,t.nodes,firstChild)) return(false);
+  if (!mapImageArray(p,size,t.nextSibling,t.nodes,nextSibling)) return(false);
+  if (!mapImageArray(p,size,t.lineNos,t.nodes,lineNos)) return(false);
+  if (!mapImageArray(p,size,t.depths,t.nodes,depths)) return(false);
+  if (!mapImageArray(p,size,t.payload,t.nodes,payload)) return(false);
+  if (!mapImageArray(p,size,t.values,t.data,data)) return(false);
+  if (!testImage(size,t.stringTable,t.strings,sizeof(std::uint64_t))) return(false);
+  if (!testImage(size,t.frameTable,t.frames,sizeof(std::uint64_t))) return(false);
+  stringIndex.reset();
+  strings.resize(t.strings);
+  for (index_t i=0;i<t.strings;i++) {
+    std::uint64_t o;
+    std::memcpy(&o,p+t.stringTable+i*sizeof(o),sizeof(o));
+    if (!loadImageString(p,size,o,strings[i])) return(false);
+  }
+  frames.resize(t.frames);
+  for (index_t i=0;i<t.frames;i++) {
+    std::uint64_t o,count;
+    std::memcpy(&o,p+t.frameTable+i*sizeof(o),sizeof(o));
+    if (!testImage(size,o,1,sizeof(count))) return(false);
+    std::memcpy(&count,p+o,sizeof(count));
+    if ((count>tokens_t::maxSize)||!testImage(size,o,count+1,sizeof(count))) return(false);
+    frames[i]=tokens_t(count);
+    for (tokens_t::index_t k=0;k<count;k++) {
+      std::uint64_t slot;
+      std::string value;
+      std::memcpy(&slot,p+o+(k+1)*sizeof(slot),sizeof(slot));
+      if (slot&&(!loadImageString(p,size,slot,value)||!frames[i].set(k,std::move(value)))) return(false);
+    }
+  }
+  if (!check()) return(false);
+  image=image_in;
+  links=links_in;
+  return(true);
+}
+void Tree::finish(){
+  stringIndex.reset();
+  kinds.shrink_to_fit();
+  flags.shrink_to_fit();
+  firstChild.shrink_to_fit();
+  nextSibling.shrink_to_fit();
+  lineNos.shrink_to_fit();
+  depths.shrink_to_fit();
+  payload.shrink_to_fit();
+  data.shrink_to_fit();
+  strings.shrink_to_fit();
+  frames.shrink_to_fit();
+}
 //===========================================
 Names::name_map_t Names::nameMap;
-Line * Names::name2Line(const std::string & name){
-  if (nameMap.count(name)) return(nameMap.at(name).line);
+const Tree * Names::name2Tree(const std::string & name){
+  if (nameMap.count(name)) return(Files::id2Tree(nameMap.at(name).file_id));
   return(nullptr);
 }
+Tree::node_t Names::name2Node(const std::string & name){
+  if (nameMap.count(name)) return(nameMap.at(name).node);
+  return(Tree::none);
+}
 Files::file_id_t Names::name2id(const std::string & name){
   if (nameMap.count(name)) return(nameMap.at(name).file_id);
   return(-1);
@@ -528,8 +1408,17 @@ bool Names::erase(const std::string & name){
   }
   return(false);
 }
-void Names::add(const std::string & name,Line * line_in,Files::file_id_t file_id_in,Files::line_no_t line_no_in){
-  nameMap[name].line=line_in;
+void Names::eraseFile(Files::file_id_t file_id){
+  for (name_map_t::iterator it=nameMap.begin();it!=nameMap.end();){
+    if (it->second.file_id==file_id) {
+      it=nameMap.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+void Names::add(const std::string & name,Tree::node_t node_in,Files::file_id_t file_id_in,Files::line_no_t line_no_in){
+  nameMap[name].node=node_in;
   nameMap[name].file_id=file_id_in;
   nameMap[name].line_no=line_no_in;
 }
@@ -552,9 +1441,49 @@ std::string Names::fullName(const namespace_t & namesp,const std::string & name)
   return(out);
 }
 //===========================================
-Line::Line():parent(nullptr),fileId(-1),lineNo(-1),depth(0){
+//! Pomija spacje i tabulacje od pozycji i.
+static std::size_t skipBlanks(const std::string & s,std::size_t i){
+  while ((i<s.size())&&((s[i]==' ')||(s[i]=='\t'))) i++;
+  return(i);
+}
+//! Sprawdza, czy napis nie zawiera znaków końca linii ('\n', '\r', U+2028, U+2029 - tak jak '.' w wyrażeniach regularnych).
+static bool isSingleLine(const std::string & s){
+  for (std::size_t i=0;i<s.size();i++) switch (s[i]){
+    case '\n':case '\r':return(false);
+    case '\xE2':
+      if (((i+2)<s.size())&&(s[i+1]=='\x80')&&((s[i+2]=='\xA8')||(s[i+2]=='\xA9'))) return(false);
+      break;
+    default:break;
+  }
+  return(true);
+}
+//! Sprawdza, czy od pozycji i jest tekst 'lead', po którym jest co najmniej jeden biały znak.
+static bool isLead(const std::string & s,std::size_t i,const std::string & lead){
+  if (s.compare(i,lead.size(),lead)) return(false);
+  i+=lead.size();
+  return((i<s.size())&&((s[i]==' ')||(s[i]=='\t')));
+}
+//! Sprawdza, czy linia to dyrektywa 'include' (te same warunki co w Line::factory).
+static bool isInclude(const std::string & s){
+  static const std::string s_include("include");
+  const std::size_t i(skipBlanks(s,0));
+  if ((i>=s.size())||(s[i]!='%')) return(false);
+  return(isLead(s,skipBlanks(s,i+1),s_include)&&isSingleLine(s));
+}
+//! Sprawdza, czy znak może być częścią nazwy ([a-zA-Z0-9_$]).
+static bool isNameChar(char c){
+  return((('a'<=c)&&(c<='z'))||(('A'<=c)&&(c<='Z'))||(('0'<=c)&&(c<='9'))||(c=='_')||(c=='$'));
+}
+//! Sprawdza, czy napis jest liczbą (same cyfry).
+static bool isNumber(const std::string & s){
+  if (!s.size()) return(false);
+  for (const char c : s) if ((c<'0')||('9'<c)) return(false);
+  return(true);
+}
+//===========================================
+Line::Line():fileId(-1),lineNo(-1),depth(0){
 }
-Line::Line(const std::string & line_in,Files::file_id_t fileId_in,Files::line_no_t lineNo_in):parent(nullptr),fileId(fileId_in),lineNo(lineNo_in),depth(0){
+Line::Line(const std::string & line_in,Files::file_id_t fileId_in,Files::line_no_t lineNo_in):fileId(fileId_in),lineNo(lineNo_in),depth(0){
   std::string sline(line_in);
   std::wstring wline;
   ict::global::transferUTF(sline,wline);
@@ -569,12 +1498,6 @@ Line::Line(const std::string & line_in,Files::file_id_t fileId_in,Files::line_no
     }
   }
 }
-bool Line::addParent(Line * ptr){
-  if (!ptr) return(false);
-  if (parent) return(false);
-  parent=ptr;
-  return(true);
-}
 std::ostream & Line::log(const std::string & level){
   Files::line_no_t l((lineNo==-1)?0:lineNo);
   depth_t d((depth==-1)?0:depth);
@@ -585,12 +1508,21 @@ std::ostream & Line::log(const std::string & level){
   return(std::cerr);
 }
 bool Line::testName(const std::string & name){
-  const static std::wstring name_item(L"([a-zA-Z0-9_$]+)");
-  static std::wregex r(L"("+name_item+L"?(-"+name_item+L")+)|"+name_item,std::regex_constants::collate|std::regex_constants::nosubs);
-  std::string sname(name);
-  std::wstring wname;
-  ict::global::transferUTF(sname,wname);
-  return(std::regex_match(wname,r));
+  //Nazwy: 'a', 'a-b-c' lub '-a-b' (tylko pierwszy człon może być pusty).
+  std::size_t item=0;
+  bool first=true;
+  for (const char c : name){
+    if (c=='-'){
+      if ((!item)&&(!first)) return(false);
+      first=false;
+      item=0;
+    } else if (isNameChar(c)){
+      item++;
+    } else {
+      return(false);
+    }
+  }
+  return(item>0);
 }
 std::string Line::getThisPath(){
   std::string out;
@@ -601,101 +1533,110 @@ std::string Line::getThisPath(){
   }
   return(out);
 }
-bool Line::addChild(ptr_t & ptr){
-  if (ptr){
-    if ((getDepth())<(ptr->getDepth())){
-      childrenList.push_back(ptr);
-      return(ptr->addParent(this));
-    } else {
-      if (parent) return(parent->addChild(ptr));
-    }
-  }
-  return(false);
-}
-void Line::getChildren(line_list_t & lines){
-  lines.clear();
-  lines.push_back(this);
-  for (ptr_t & p:childrenList){
-    if (p) lines.push_back(p.get());
-  }
-}
 Line::ptr_t Line::factory(const std::string & line_in,Files::file_id_t fileId_in,Files::line_no_t lineNo_in){
-  const static std::wstring space_o(L"[ \\t]*");
-  const static std::wstring space_m(L"[ \\t]+");
-  const static std::wstring percent(space_o+L"%"+space_o);
-  const static std::wstring end(L".*");
-  static std::wregex r_LineInclude(percent+L"include"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineNamespace(percent+L"namespace"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineClone(percent+L"clone"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineDefine(percent+L"define"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineText(space_o+L"-"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineHtml(space_o+L"="+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineComment(space_o+L"/"+space_m+end,std::regex_constants::nosubs);
-  static std::wregex r_LineMock(space_o+L"//"+space_m+end,std::regex_constants::nosubs);
-  std::string sline(line_in);
-  std::wstring wline;
-  ict::global::transferUTF(sline,wline);
-  #define LINE_FACTORY_REGEX(classname) \
-  if (std::regex_match(wline,r_##classname)){ \
+  const static std::string s_include("include");
+  const static std::string s_namespace("namespace");
+  const static std::string s_clone("clone");
+  const static std::string s_define("define");
+  const static std::string s_text("-");
+  const static std::string s_html("=");
+  const static std::string s_comment("/");
+  const static std::string s_mock("//");
+  #define LINE_FACTORY_LEAD(classname,kind,from,lead) \
+  if (isLead(line_in,from,lead)){ \
     ptr_t ptr(new classname(line_in,fileId_in,lineNo_in)); \
+    Stats::line(kind); \
+    ICT_PROBE(dorothy,line_created,int(kind),fileId_in,lineNo_in); \
     return(ptr); \
-  } else
-  LINE_FACTORY_REGEX(LineInclude)
-  LINE_FACTORY_REGEX(LineNamespace)
-  LINE_FACTORY_REGEX(LineClone)
-  LINE_FACTORY_REGEX(LineDefine)
-  LINE_FACTORY_REGEX(LineText)
-  LINE_FACTORY_REGEX(LineHtml)
-  LINE_FACTORY_REGEX(LineComment)
-  LINE_FACTORY_REGEX(LineMock)
+  }
+  if (isSingleLine(line_in)){
+    const std::size_t i(skipBlanks(line_in,0));
+    if ((i<line_in.size())&&(line_in[i]=='%')){
+      const std::size_t k(skipBlanks(line_in,i+1));
+      LINE_FACTORY_LEAD(LineInclude,Tree::kind_include,k,s_include)
+      LINE_FACTORY_LEAD(LineNamespace,Tree::kind_namespace,k,s_namespace)
+      LINE_FACTORY_LEAD(LineClone,Tree::kind_clone,k,s_clone)
+      LINE_FACTORY_LEAD(LineDefine,Tree::kind_define,k,s_define)
+    }
+    LINE_FACTORY_LEAD(LineText,Tree::kind_text,i,s_text)
+    LINE_FACTORY_LEAD(LineHtml,Tree::kind_html,i,s_html)
+    LINE_FACTORY_LEAD(LineComment,Tree::kind_comment,i,s_comment)
+    LINE_FACTORY_LEAD(LineMock,Tree::kind_mock,i,s_mock)
+  }
+  #undef LINE_FACTORY_LEAD
   {
     ptr_t ptr(new LineNode(line_in,fileId_in,lineNo_in));
+    Stats::line(Tree::kind_node);
+    ICT_PROBE(dorothy,line_created,int(Tree::kind_node),fileId_in,lineNo_in);
     return(ptr);
   }
 }
-int Line::parse(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount){
+int Line::parse(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount,Tree & tree,Tree::node_t root,Cache::entry_t * entry){
+  //! Otwarty węzeł - kolejne linie o większym wcięciu są jego dziećmi.
+  struct open_t {depth_t depth;Tree::node_t node;Tree::node_t last;};
+  std::vector<open_t> opened;
   std::string line_in;
-  Files::line_no_t lineNo_in(lineCount);
-  if (Files::getLine(input,lineCount,line_in)){
+  opened.push_back({getDepth(),root,Tree::none});
+  Stats::phase(Stats::phase_lex);
+  for (Files::line_no_t lineNo_in(lineCount);Files::getLine(input,lineCount,line_in);lineNo_in=lineCount){
     ptr_t ptr(Line::factory(line_in,fileId_in,lineNo_in));
     int out=ptr->parseLine(options);
     if (out) return(out);
+    Stats::phase(Stats::phase_parse);
     if (!options.testMaxDepth(ptr->getDepth())){
       ptr->error()<<"Max depth reached ("<<options.getMaxDepth()<<") - change --max-depth param!"<<std::endl;
       return(__LINE__);
     }
-    if(!addChild(ptr)){
-      ptr->error()<<"Unable to add a child!"<<std::endl;
-      return(__LINE__);
+    while ((opened.size()>1)&&(ptr->getDepth()<=opened.back().depth)) opened.pop_back();
+    {
+      open_t & o(opened.back());
+      Tree::node_t n(Tree::none);
+      if (o.node!=Tree::none){
+        n=ptr->compile(tree,o.node,o.last);
+        o.last=n;
+      }
+      opened.push_back({ptr->getDepth(),n,Tree::none});
+      if (entry){
+        if (entry->maxDepth<ptr->getDepth()) entry->maxDepth=ptr->getDepth();
+        if (ptr->keep()) entry->includes.push_back({line_in,lineNo_in,n});
+      }
     }
-    return(ptr->parse(options,input,fileId_in,lineCount));
+    if (ptr->keep()) childrenList.push_back(ptr);
+    Stats::phase(Stats::phase_lex);
   }
   return(0);
 }
-int Line::serializeLine(const Options & options,std::ostream & output){
-  depth_t depth(0);
-  unsigned int comments(0);
-  namespace_t namesp;
-  line_list_t lines;
-  return(serialize(options,output,namesp,options.getTokens(),lines,depth,comments));
-}
-int Line::serializeChildren(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  if (!options.testMaxDepth(depth_in)){
-    error()<<"Max depth reached ("<<options.getMaxDepth()<<") - change --max-depth param!"<<std::endl;
-    return(__LINE__);
+int Line::restore(const Options & options,Tree & tree,const Cache::entry_t & entry){
+  for (const Cache::include_t & i : entry.includes){
+    ptr_t ptr(Line::factory(i.line,fileId,i.lineNo));
+    int out=ptr->parseLine(options);
+    if (out) return(out);
+    if (i.node!=Tree::none) tree.setValue(i.node,1,ptr->getLinkedId());
+    childrenList.push_back(ptr);
   }
-  depth_in++;
-  for (ptr_t & c : childrenList){
-    out=c->serialize(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in);
+  return(0);
+}
+int Line::scan(const Options & options,std::istream & input,Files::file_id_t fileId_in,Files::line_no_t & lineCount){
+  std::string line_in;
+  Stats::phase(Stats::phase_lex);
+  for (Files::line_no_t lineNo_in(lineCount);Files::getLine(input,lineCount,line_in);lineNo_in=lineCount) if (isInclude(line_in)) {
+    ptr_t ptr(Line::factory(line_in,fileId_in,lineNo_in));
+    int out=ptr->parseLine(options);
     if (out) return(out);
+    if (!options.testMaxDepth(ptr->getDepth())){
+      ptr->error()<<"Max depth reached ("<<options.getMaxDepth()<<") - change --max-depth param!"<<std::endl;
+      return(__LINE__);
+    }
+    if (ptr->keep()) childrenList.push_back(ptr);
   }
   return(0);
 }
+void Line::getIncludes(Files::file_list_t & includes) const {
+  for (const ptr_t & c : childrenList) includes.push_back(c->getLinkedId());
+}
+Tree::node_t Line::addNode(Tree & tree,Tree::kind_t kind,Tree::node_t parent,Tree::node_t previous) const {
+  return(tree.add(kind,parent,previous,lineNo,depth));
+}
 int Line::dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last){
   int out;
   for (ptr_t & c : childrenList){
@@ -705,19 +1646,462 @@ int Line::dependences(const Options & options,std::ostream & output,Files::file_
   return(0);
 }
 //===========================================
+std::string Cache::dir;
+std::uint64_t Cache::maxSize=0;
+//! Skrót FNV-1a (64 bity).
+static std::uint64_t hashFnv(const std::string & input,std::size_t pos=0,std::uint64_t h=14695981039346656037ULL){
+  for (std::string::const_iterator it=input.begin()+pos;it!=input.end();++it) {
+    h^=(unsigned char)(*it);
+    h*=1099511628211ULL;
+  }
+  return(h);
+}
+//! Czyta cały plik (jedna alokacja, gdy plik pozwala na ustalenie rozmiaru).
+static void readBytes(std::istream & input,std::string & output){
+  const std::istream::pos_type size(input.seekg(0,std::istream::end).tellg());
+  input.seekg(0,std::istream::beg);
+  if ((size>0)&&input.good()) {
+    output.resize(size);
+    input.read(&output[0],size);
+    output.resize(input.gcount());
+  } else {
+    std::ostringstream oss;
+    input.clear();
+    oss<<input.rdbuf();
+    output=oss.str();
+  }
+}
+std::string Cache::header(const Options & options){
+  std::string out("dorothy-cache ");
+  out+=std::to_string(format);
+  #ifdef GIT_VERSION
+    out+=" ";
+    out+=GIT_VERSION;
+  #endif
+  out+=" ";
+  out+=options.getDefaultTag();
+  out+="\n";
+  return(out);
+}
+void Cache::setDir(const std::string & dir_in,std::uint64_t maxSize_in){
+  dir=dir_in;
+  maxSize=maxSize_in;
+  if (dir.size()&&(dir.back()!='/')) dir+='/';
+}
+std::string Cache::path(const Options & options,const std::string & content){
+  static const char hex[]="0123456789abcdef";
+  const std::string h(header(options));
+  //Dwa niezależne skróty (128 bitów) - kolizja praktycznie niemożliwa.
+  const std::uint64_t k[2]={hashFnv(content,0,hashFnv(h)),std::hash<std::string>()(h+content)};
+  std::string out(dir);
+  for (std::uint64_t v : k) for (int i=60;i>=0;i-=4) out+=hex[(v>>i)&0xF];
+  out+=".dtc";
+  return(out);
+}
+bool Cache::load(const Options & options,const std::string & path,Tree & tree,entry_t & entry){
+  const std::string h(header(options));
+  std::string input;
+  std::size_t pos(h.size());
+  std::uint64_t sum;
+  std::uint32_t count;
+  {
+    std::ifstream ifs(path,std::ifstream::in|std::ifstream::binary);
+    if (!ifs.is_open()) return(false);
+    readBytes(ifs,input);
+    Stats::read(input.size());
+  }
+  //Nagłówek, treść i suma kontrolna treści (wpis uszkodzony jest parsowany i zapisywany ponownie).
+  if ((input.size()<(h.size()+sizeof(sum)))||input.compare(0,h.size(),h)) return(false);
+  input.copy((char*)&sum,sizeof(sum),input.size()-sizeof(sum));
+  input.resize(input.size()-sizeof(sum));
+  if (hashFnv(input,h.size())!=sum) return(false);
+  if (!loadValue(input,pos,entry.maxDepth)) return(false);
+  if (!loadValue(input,pos,count)) return(false);
+  entry.includes.resize(count);
+  for (include_t & i : entry.includes) {
+    if (!loadString(input,pos,i.line)) return(false);
+    if (!loadValue(input,pos,i.lineNo)) return(false);
+    if (!loadValue(input,pos,i.node)) return(false);
+  }
+  if (!tree.load(input,pos)) return(false);
+  if (pos!=input.size()) return(false);
+  for (const include_t & i : entry.includes) if ((i.node!=Tree::none)&&((i.node>=tree.size())||(tree.kind(i.node)!=Tree::kind_include))) return(false);
+  ict::os::touchFile(path);//Kolejność LRU.
+  return(true);
+}
+void Cache::store(const Options & options,const std::string & path,const Tree & tree,const entry_t & entry){
+  std::string output;
+  saveValue(output,entry.maxDepth);
+  saveValue<std::uint32_t>(output,entry.includes.size());
+  for (const include_t & i : entry.includes) {
+    saveString(output,i.line);
+    saveValue(output,i.lineNo);
+    saveValue(output,i.node);
+  }
+  tree.save(output);
+  saveValue(output,hashFnv(output));
+  output.insert(0,header(options));
+  if (!ict::os::makeDir(dir)) return;
+  if (!ict::os::replaceFile(path,output)) return;
+  if (maxSize) ict::os::trimDir(dir,".dtc",maxSize,output.size());//Katalog jest czytany dopiero po zapisaniu 1/4 limitu (licznik w '.lock').
+}
+//===========================================
+const char Image::magic[8]={'D','O','R','O','T','H','Y','C'};
+int Image::save(Files::file_id_t root,std::ostream & output){
+  Files::file_list_t ids;
+  std::map<Files::file_id_t,Tree::index_t> index;
+  std::vector<std::uint64_t> table;
+  std::string image;
+  header_t h;
+  Files::includesAll(root,ids);
+  for (Files::file_id_t id : ids) {
+    if (!Files::id2Tree(id)) {
+      std::cerr<<"ERROR: File "<<ict::os::getRelativePath(Files::id2Path(id))<<" is not parsed!"<<std::endl;
+      return(__LINE__);
+    }
+    const Tree::index_t i(index.size());
+    index[id]=i;
+  }
+  std::memcpy(h.magic,magic,sizeof(magic));
+  h.format=format;
+  h.order=order;
+  h.files=ids.size();
+  h.reserved=0;
+  image.append(sizeof(h),'\0');
+  image.append(ids.size()*2*sizeof(std::uint64_t),'\0');
+  for (Files::file_id_t id : ids) {
+    table.push_back(saveImageString(image,Files::id2Path(id)));
+    table.push_back(Files::id2Tree(id)->saveImage(image,index));
+  }
+  h.size=image.size();
+  image.replace(0,sizeof(h),(const char*)&h,sizeof(h));
+  image.replace(sizeof(h),table.size()*sizeof(std::uint64_t),(const char*)table.data(),table.size()*sizeof(std::uint64_t));
+  output.write(image.data(),image.size());
+  Stats::written(image.size());
+  return(output.good()?0:__LINE__);
+}
+bool Image::load(const std::string & path,Files::file_id_t root,Files::file_id_t & fileCount){
+  std::size_t size;
+  std::shared_ptr<const char> image(ict::os::mapFile(path,size));
+  std::shared_ptr<std::vector<Files::file_id_t>> links(new std::vector<Files::file_id_t>());
+  std::vector<std::shared_ptr<Tree>> trees;
+  header_t h;
+  if ((!image)||(size<sizeof(h))) return(false);
+  Stats::read(size);
+  std::memcpy(&h,image.get(),sizeof(h));
+  if (std::memcmp(h.magic,magic,sizeof(magic))||(h.format!=format)||(h.order!=order)||(h.size!=size)||(!h.files)) return(false);
+  if (!testImage(size,sizeof(h),2*std::uint64_t(h.files),sizeof(std::uint64_t))) return(false);
+  for (std::uint32_t i=0;i<h.files;i++) links->push_back(i?fileCount++:root);
+  for (std::uint32_t i=0;i<h.files;i++) {
+    std::uint64_t t[2];
+    std::string source;
+    std::memcpy(t,image.get()+sizeof(h)+i*sizeof(t),sizeof(t));
+    trees.emplace_back(new Tree((*links)[i]));
+    if (!loadImageString(image.get(),size,t[0],source)) return(false);
+    if (!trees.back()->mapImage(image,size,t[1],links)) return(false);
+    if (i) Files::addImage((*links)[i],root,source,trees.back());
+  }
+  Files::setTree(root,trees.front());
+  return(true);
+}
+//===========================================
+const std::size_t Stats::none;
+bool Stats::enabled=false;
+std::vector<Stats::frame_t> Stats::frames;
+std::uint64_t Stats::wallMark=0;
+std::uint64_t Stats::cpuMark=0;
+stats_t Stats::stats;
+time_stats_t Stats::phases[Stats::phase_count];
+std::uint64_t Stats::lines[Tree::kind_node+1];
+Stats::Frame::Frame(phase_t phase_in):active(enabled){
+  if (!active) return;
+  tick(true);
+  frames.push_back({phase_in,none,{}});
+}
+Stats::Frame::~Frame(){
+  if (!active) return;
+  tick(true);
+  frames.pop_back();
+}
+std::uint64_t Stats::wallClock(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+time_stats_t * Stats::fileTime(phase_t phase){
+  if (frames.back().file==none) return(nullptr);
+  file_stats_t & f(stats.files[frames.back().file]);
+  switch (phase){
+    case phase_read:return(&f.read);
+    case phase_lex:return(&f.lex);
+    case phase_parse:return(&f.parse);
+    case phase_link:return(&f.link);
+    default:break;
+  }
+  return(nullptr);
+}
+void Stats::tick(bool cpu){
+  const std::uint64_t wall(wallClock());
+  if (frames.size()){
+    frame_t & f(frames.back());
+    const std::uint64_t d(wall-wallMark);
+    time_stats_t * t(fileTime(f.phase));
+    f.segment[f.phase]+=d;
+    phases[f.phase].wall+=d;
+    if (t) t->wall+=d;
+  }
+  wallMark=wall;
+  if (!cpu) return;
+  {
+    const std::uint64_t c(ict::os::getCpuTime());
+    if (frames.size()){
+      frame_t & f(frames.back());
+      const std::uint64_t d(c-cpuMark);
+      std::uint64_t total=0;
+      for (int p=0;p<phase_count;p++) total+=f.segment[p];
+      for (int p=0;p<phase_count;p++) {
+        //Bez pomiaru czasu ściennego cały czas procesora dostaje bieżąca faza.
+        const std::uint64_t share(total?std::uint64_t(double(d)*f.segment[p]/total):((p==f.phase)?d:0));
+        time_stats_t * t(fileTime((phase_t)p));
+        phases[p].cpu+=share;
+        if (t) t->cpu+=share;
+        f.segment[p]=0;
+      }
+    }
+    cpuMark=c;
+  }
+}
+void Stats::change(phase_t phase_in){
+  if (frames.empty()||(frames.back().phase==phase_in)) return;
+  tick(false);
+  frames.back().phase=phase_in;
+}
+void Stats::reset(){
+  frames.clear();
+  stats=stats_t();
+  for (time_stats_t & t : phases) t=time_stats_t();
+  for (std::uint64_t & l : lines) l=0;
+}
+void Stats::file(const std::string & path){
+  if (!(enabled&&frames.size())) return;
+  tick(true);
+  frames.back().file=stats.files.size();
+  stats.files.emplace_back();
+  stats.files.back().path=path;
+}
+void Stats::read(std::uint64_t bytes){
+  if (!enabled) return;
+  stats.bytesRead+=bytes;
+  if (frames.size()&&(frames.back().file!=none)) stats.files[frames.back().file].bytes+=bytes;
+}
+void Stats::get(stats_t & stats_out){
+  static const char * names[Tree::kind_node+1]={
+    "LineFile","LineInclude","LineNamespace","LineDefine","LineClone",
+    "LineText","LineHtml","LineComment","LineMock","LineNode"
+  };
+  stats_out=stats;
+  stats_out.read=phases[phase_read];
+  stats_out.lex=phases[phase_lex];
+  stats_out.parse=phases[phase_parse];
+  stats_out.link=phases[phase_link];
+  stats_out.render=phases[phase_render];
+  stats_out.estimate=phases[phase_estimate];
+  for (int k=0;k<=Tree::kind_node;k++) if (lines[k]) stats_out.lines[names[k]]=lines[k];
+}
+CountBuf::int_type CountBuf::overflow(int_type c){
+  if (traits_type::eq_int_type(c,traits_type::eof())) return(traits_type::not_eof(c));
+  if (target&&traits_type::eq_int_type(target->sputc(traits_type::to_char_type(c)),traits_type::eof())) return(traits_type::eof());
+  count++;
+  return(c);
+}
+ReadBuf::int_type ReadBuf::underflow(){
+  if (!Stats::on()) return(std::filebuf::underflow());
+  {
+    const Stats::phase_t phase(Stats::current());
+    Stats::phase(Stats::phase_read);
+    const int_type out(std::filebuf::underflow());
+    Stats::phase(phase);
+    return(out);
+  }
+}
+bool ReadBuf::startsWith(const char * prefix,std::size_t size){
+  if (traits_type::eq_int_type(sgetc(),traits_type::eof())) return(false);
+  return((std::size_t(egptr()-gptr())>=size)&&!std::memcmp(gptr(),prefix,size));
+}
+std::streamsize CountBuf::xsputn(const char * s,std::streamsize n){
+  const std::streamsize out(target?target->sputn(s,n):n);
+  count+=out;
+  return(out);
+}
+std::streambuf::pos_type CountBuf::seekoff(off_type off,std::ios_base::seekdir dir,std::ios_base::openmode which){
+  if ((!off)&&(dir==std::ios_base::cur)&&(which&std::ios_base::out)) return(pos_type(off_type(count)));
+  return(pos_type(off_type(-1)));
+}
+//===========================================
+bool Profile::enabled=false;
+std::vector<Profile::context_t> Profile::contexts;
+std::map<std::string,std::size_t> Profile::active;
+Profile::cost_map_t Profile::defines;
+Profile::cost_map_t Profile::includes;
+std::map<std::string,Profile::line_map_t> Profile::stacks;
+Profile::line_map_t Profile::lines;
+std::map<Files::file_id_t,std::string> Profile::paths;
+void Profile::reset(){
+  contexts.clear();
+  active.clear();
+  defines.clear();
+  includes.clear();
+  stacks.clear();
+  lines.clear();
+  paths.clear();
+}
+const std::string & Profile::path(Files::file_id_t id){
+  std::map<Files::file_id_t,std::string>::const_iterator it(paths.find(id));
+  if (it==paths.cend()) {
+    std::string p(ict::os::getRelativePath(Files::id2Path(id)));
+    std::replace(p.begin(),p.end(),';','_');//Separator ramek stosu.
+    it=paths.emplace(id,p).first;
+  }
+  return(it->second);
+}
+void Profile::push(kind_t kind,Files::file_id_t id){
+  push(kind,path(id));
+}
+void Profile::push(kind_t kind,const std::string & name){
+  static const char * labels[]={"file ","include ","define "};
+  const std::string key(labels[kind]+name);
+  const bool outer(!(active[key]++));
+  context_t c{kind,name,contexts.size()?(contexts.back().stack+";"+key):key,nullptr,nullptr};
+  std::replace(c.stack.begin()+(c.stack.size()-key.size()),c.stack.end(),';','_');
+  c.lines=&stacks[c.stack];
+  if (kind!=kind_file) {
+    cost_t & total((kind==kind_define)?defines[name]:includes[name]);
+    total.count++;
+    if (outer) c.total=&total;
+  }
+  contexts.push_back(std::move(c));
+}
+void Profile::pop(){
+  static const char * labels[]={"file ","include ","define "};
+  const context_t & c(contexts.back());
+  active[labels[c.kind]+c.name]--;
+  contexts.pop_back();
+}
+void Profile::add(std::size_t depth_in,const Tree & tree,Tree::node_t n,std::uint64_t ns,std::uint64_t bytes,bool render){
+  const std::uint64_t line((std::uint64_t(tree.getFileId())<<32)|((tree.lineNo(n)==Files::line_no_t(-1))?0:tree.lineNo(n)));
+  for (line_map_t * m : {&lines,(depth_in&&(depth_in<=contexts.size()))?contexts[depth_in-1].lines:&stacks[std::string()]}){
+    cost_t & c((*m)[line]);
+    c.ns+=ns;
+    c.bytes+=bytes;
+    if (render) c.count++;
+  }
+  for (std::size_t i=0;(i<depth_in)&&(i<contexts.size());i++) if (contexts[i].total) {
+    contexts[i].total->ns+=ns;
+    contexts[i].total->bytes+=bytes;
+  }
+}
+void Profile::top(std::ostream & output,const std::string & title,const std::vector<std::pair<std::string,cost_t>> & items,const cost_t & total,std::size_t count){
+  std::vector<std::pair<std::string,cost_t>> sorted(items);
+  std::sort(sorted.begin(),sorted.end(),[](const std::pair<std::string,cost_t> & a,const std::pair<std::string,cost_t> & b){
+    return((a.second.ns!=b.second.ns)?(a.second.ns>b.second.ns):(a.first<b.first));
+  });
+  if (sorted.size()>count) sorted.resize(count);
+  output<<" "<<title<<" (top "<<sorted.size()<<" of "<<items.size()<<"):"<<std::endl;
+  output<<"  "<<std::setw(10)<<"time[ms]"<<std::setw(8)<<"time%"<<std::setw(12)<<"bytes"<<std::setw(8)<<"bytes%"<<std::setw(10)<<"count"<<"  name"<<std::endl;
+  for (const std::pair<std::string,cost_t> & i : sorted){
+    output<<"  "<<std::fixed<<std::setprecision(3)<<std::setw(10)<<(i.second.ns/1e6);
+    output<<std::setprecision(1)<<std::setw(8)<<(total.ns?(100.0*i.second.ns/total.ns):0.0);
+    output<<std::setw(12)<<i.second.bytes;
+    output<<std::setw(8)<<(total.bytes?(100.0*i.second.bytes/total.bytes):0.0);
+    output<<std::setw(10)<<i.second.count<<"  "<<i.first<<std::endl;
+  }
+}
+void Profile::report(std::ostream & output,std::size_t count){
+  cost_t total{0,0,0};
+  std::vector<std::pair<std::string,cost_t>> items;
+  std::map<Files::file_id_t,cost_t> files;
+  for (const auto & l : lines) {
+    cost_t & f(files[l.first>>32]);
+    total.ns+=l.second.ns;
+    total.bytes+=l.second.bytes;
+    f.ns+=l.second.ns;
+    f.bytes+=l.second.bytes;
+    f.count+=l.second.count;
+  }
+  output<<"Profile: render time "<<std::fixed<<std::setprecision(3)<<(total.ns/1e6)<<" ms, output "<<total.bytes<<" bytes"<<std::endl;
+  items.assign(defines.cbegin(),defines.cend());
+  top(output,"Defines (with nested nodes, count - clone expansions)",items,total,count);
+  items.assign(includes.cbegin(),includes.cend());
+  top(output,"Includes (with nested nodes, count - include expansions)",items,total,count);
+  items.clear();
+  for (const auto & f : files) items.emplace_back(path(f.first),f.second);
+  top(output,"Files (own nodes, count - rendered nodes)",items,total,count);
+  items.clear();
+  for (const auto & l : lines) items.emplace_back(path(l.first>>32)+":"+std::to_string(l.first&0xffffffff),l.second);
+  top(output,"Lines (count - rendered nodes)",items,total,count);
+}
+void Profile::collapsed(std::ostream & output){
+  for (const auto & s : stacks) for (const auto & l : s.second) {
+    if (s.first.size()) output<<s.first<<";";
+    output<<path(l.first>>32)<<":"<<(l.first&0xffffffff)<<" "<<l.second.ns<<std::endl;
+  }
+}
+//===========================================
+bool Trace::enabled=false;
+std::vector<Trace::event_t> Trace::events;
+std::vector<std::size_t> Trace::open;
+void Trace::begin(const char * category,const std::string & name){
+  open.push_back(events.size());
+  events.push_back({category,name,Profile::clock(),0});
+}
+void Trace::end(){
+  if (open.empty()) return;
+  event_t & e(events[open.back()]);
+  e.duration=Profile::clock()-e.start;
+  open.pop_back();
+}
+void Trace::string(std::ostream & output,const std::string & in){
+  static const char hex[]="0123456789abcdef";
+  output<<'"';
+  for (const char c : in) switch (c){
+    case '"':output<<"\\\"";break;
+    case '\\':output<<"\\\\";break;
+    default:
+      if ((unsigned char)c<0x20) {
+        output<<"\\u00"<<hex[(c>>4)&0xf]<<hex[c&0xf];
+      } else {
+        output<<c;
+      }
+      break;
+  }
+  output<<'"';
+}
+void Trace::write(std::ostream & output,long pid,const std::string & process){
+  truncate(0);
+  output<<"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":"<<pid<<",\"tid\":"<<pid<<",\"args\":{\"name\":";
+  string(output,process);
+  output<<"}}";
+  for (const event_t & e : events){
+    output<<","<<std::endl<<"{\"name\":";
+    string(output,e.name);
+    output<<",\"cat\":\""<<e.category<<"\",\"ph\":\"X\",\"pid\":"<<pid<<",\"tid\":"<<pid;
+    output<<",\"ts\":"<<(e.start/1000)<<"."<<std::setw(3)<<std::setfill('0')<<(e.start%1000);
+    output<<",\"dur\":"<<(e.duration/1000)<<"."<<std::setw(3)<<std::setfill('0')<<(e.duration%1000)<<std::setfill(' ')<<"}";
+  }
+  events.clear();
+}
+//===========================================
 Files::file_id_t LineFile::fileCount=0;
 LineFile::LineFile(const std::string & path_in):path(ict::os::getRealPath(path_in)),Line(){
   fileId=fileCount;
   fileCount++;
+  Stats::line(Tree::kind_file);
 }
 LineFile::LineFile(const std::string & base_in,const std::string & path_in):path(ict::os::getRealPath(base_in,path_in)),Line(){
   fileId=fileCount;
   fileCount++;
-}
-LineFile::~LineFile(){
-  fileCount--;
+  Stats::line(Tree::kind_file);
 }
 int LineFile::parseLine(const Options & options){
+  Stats::Frame frame(Stats::phase_link);
   if (!path.size()){
     error()<<"File path is missing !"<<std::endl;
     return(__LINE__);
@@ -725,8 +2109,8 @@ int LineFile::parseLine(const Options & options){
   if (path!="-") {
     if (!ict::os::isFileReadable(path)){
       static const std::string s_dorothy("dorothy");
-      static std::regex r_dorothy(".*\\."+s_dorothy);
-      if (std::regex_match(path,r_dorothy)) {
+      static const std::string s_ext("."+s_dorothy);
+      if ((path.size()>=s_ext.size())&&(!path.compare(path.size()-s_ext.size(),s_ext.size(),s_ext))&&(path.find_first_of("\r\n")==std::string::npos)) {
         error()<<"Unable to find file "<<ict::os::getRelativePath(path)<<" !"<<std::endl;
         return(__LINE__);
       }
@@ -743,41 +2127,95 @@ int LineFile::parseLine(const Options & options){
   if (linkedId==-1){
     Files::add(fileId,this,path);
     linkedId=fileId;
+  } else if (Files::isStale(linkedId)) {//Ponowne parsowanie z tym samym identyfikatorem.
+    fileId=linkedId;
+    Files::add(fileId,this,path);
   } else {
     return(0);
   }
+  Stats::file(path);
+  Trace::Span span("parse",Trace::on()?("parse "+ict::os::getRelativePath(path)):std::string());
+  ICT_PROBE(dorothy,parse_start,path.c_str(),fileId);
+  struct probe_t {//Punkt 'parse_end' na każdym wyjściu z funkcji.
+    const LineFile & file;
+    ~probe_t(){ICT_PROBE(dorothy,parse_end,file.path.c_str(),file.fileId);}
+  } probe{*this};
   {
     int out;
     Files::line_no_t lineCount(1);
+    std::shared_ptr<Tree> tree;
+    ReadBuf buffer;
+    std::istream ifs(&buffer);
+    std::istringstream content;
+    //! Drzewo z pamięci podręcznej na dysku (komunikaty -vv powstają tylko przy parsowaniu).
+    const bool cached((path!="-")&&(!options.getScan())&&Cache::enabled()&&(options.getVerbose()<=LOG_NOTICE));
+    std::istream & input((path=="-")?std::cin:(cached?(std::istream&)content:ifs));
+    if (path!="-") {
+      Stats::phase(Stats::phase_read);
+      if (!buffer.open(path,std::ios_base::in)) ifs.setstate(std::ios_base::failbit);
+      if (buffer.startsWith(Image::magic,sizeof(Image::magic))) {//Plik prekompilowany - bez parsowania i bez zależności (pliki źródłowe nie są potrzebne).
+        buffer.close();
+        if ((!options.getScan())&&(!Image::load(path,fileId,fileCount))){
+          error()<<"Invalid precompiled file "<<ict::os::getRelativePath(path)<<" !"<<std::endl;
+          return(__LINE__);
+        }
+        Files::setIncludes(fileId,Files::file_list_t());
+        line.clear();
+        return(0);
+      }
+    }
     if (options.getVerbose()>LOG_NOTICE) notice()<<"Parsing input "<<ict::os::getRelativePath(path)<<" (start)."<<std::endl;
-    if (path=="-") {
-      out=parse(options,std::cin,fileId,lineCount);
+    if (options.getScan()) {
+      out=scan(options,input,fileId,lineCount);
+    } else if (cached) {
+      Cache::entry_t entry{0,{}};
+      std::string bytes,entryPath;
+      readBytes(ifs,bytes);
+      entryPath=Cache::path(options,bytes);
+      tree.reset(new Tree(fileId));
+      if (Cache::load(options,entryPath,*tree,entry)&&options.testMaxDepth(entry.maxDepth)){
+        Stats::phase(Stats::phase_link);
+        out=restore(options,*tree,entry);
+      } else {
+        content.str(bytes);
+        bytes.clear();
+        bytes.shrink_to_fit();
+        entry=Cache::entry_t{0,{}};
+        tree.reset(new Tree(fileId));
+        out=parse(options,input,fileId,lineCount,*tree,compile(*tree,Tree::none,Tree::none),&entry);
+        if (!out) {
+          tree->finish();
+          Cache::store(options,entryPath,*tree,entry);
+        }
+      }
     } else {
-      std::ifstream ifs(path,std::ifstream::in);
-      out=parse(options,ifs,fileId,lineCount);
-      ifs.close();
+      tree.reset(new Tree(fileId));
+      out=parse(options,input,fileId,lineCount,*tree,compile(*tree,Tree::none,Tree::none));
+    }
+    if (path!="-") {
+      if (Stats::on()) Stats::read(std::max<std::streamoff>(buffer.pubseekoff(0,std::ios_base::cur,std::ios_base::in),0));
+      buffer.close();
     }
     if (out) return(out);
+    Stats::fileLines(lineCount-1);
+    Stats::phase(Stats::phase_link);
     if (options.getVerbose()>LOG_NOTICE) notice()<<"Parsing input "<<ict::os::getRelativePath(path)<<" (stop)."<<std::endl;
+    if (tree) {
+      tree->finish();
+      Files::setTree(fileId,tree);
+    }
+  }
+  {
+    Files::file_list_t includes;
+    getIncludes(includes);
+    Files::setIncludes(fileId,includes);
   }
   line.clear();
   return(0);
 }
-int LineFile::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  Line * ptr=Files::id2Line(linkedId);
-  if (ptr){
-    out=ptr->serializeChildren(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in);
-    if (out) return(out);
-  } else {
-    error()<<"Internal error ("<<__FILE__<<":"<<__LINE__<<")!"<<std::endl;
-    return(14);
-  }
-  return(0);
+Tree::node_t LineFile::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_file,parent,previous));
+  return(n);
 }
 int LineFile::dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last){
   int out;
@@ -793,62 +2231,67 @@ int LineFile::dependences(const Options & options,std::ostream & output,Files::f
 }
 //===========================================
 int LineTokens::loadTokens(const Options & options){
-  const static std::wstring space_o(L"[ \\t]*");
-  const static std::wstring space_m(L"[ \\t]+");
-  const static std::wstring percent(space_o+L"%"+space_o);
-  const static std::wstring directive(L"[a-z]+");
-  const static std::wstring end(L"(.*)");
-  static std::wregex r(percent+directive+space_m+end);
-  std::wsmatch match;
-  std::size_t k=0;
-  wchar_t q(L'\0');
-  wchar_t l(L'\0');
-  std::wstring wtoken;
+  const std::size_t size(line.size());
+  std::size_t i=0;
+  char q('\0');
+  char l('\0');
+  std::string token;
   bool empty=true;
-  std::string sline(line);
-  std::wstring wline;
-  ict::global::transferUTF(sline,wline);
-  wline+=L'\0';
-  if ((std::regex_match(wline,match,r))&&(match.size()>1)) {
-    wline=match[1];
+  //Pomijany jest znak '%' i nazwa dyrektywy (rodzaj linii rozpoznała już metoda Line::factory).
+  #define LINE_TOKENS_BLANKS while ((i<size)&&((line[i]==' ')||(line[i]=='\t'))) i++;
+  LINE_TOKENS_BLANKS
+  if ((i<size)&&(line[i]=='%')) {
+    i++;
+    LINE_TOKENS_BLANKS
+    std::size_t k(i);
+    while ((i<size)&&(line[i]>='a')&&(line[i]<='z')) i++;
+    if (k==i) i=size+1;
+    k=i;
+    LINE_TOKENS_BLANKS
+    if (k==i) i=size+1;
   } else {
+    i=size+1;
+  }
+  #undef LINE_TOKENS_BLANKS
+  if (i>size) {
     error()<<"Internal parsing error !"<<std::endl;
     return(__LINE__);
   }
-  for (wchar_t c : wline){
-    if (l==L'\\'){//Poprzednio był znak ucieczki.
+  tokens=tokens_t(4);
+  for (;i<=size;i++){//Znak '\0' na końcu zamyka ostatni token.
+    const char c((i<size)?line[i]:'\0');
+    if (l=='\\'){//Poprzednio był znak ucieczki.
       switch(c){
-        case L'n' :wtoken+=L'\n';break;
-        case L'r' :wtoken+=L'\r';break;
-        case L't' :wtoken+=L'\t';break;
-        case L'v' :wtoken+=L'\v';break;
-        case L'0' :wtoken+=L'\0';break;
-        default:if (c) wtoken+=c;break;
+        case 'n' :token+='\n';break;
+        case 'r' :token+='\r';break;
+        case 't' :token+='\t';break;
+        case 'v' :token+='\v';break;
+        case '0' :token+='\0';break;
+        default:if (c) token+=c;break;
       }
       empty=false;
-    } else if (c==L'\\') {//Teraz jest znak ucieczki.
+    } else if (c=='\\') {//Teraz jest znak ucieczki.
       empty=false;
-    } else if (q==L'\0'){//Nie było cudzysłowa.
-      if ((c==L'"')||(c==L'\'')) {//Zaczyna się cudzysłów.
+    } else if (q=='\0'){//Nie było cudzysłowa.
+      if ((c=='"')||(c=='\'')) {//Zaczyna się cudzysłów.
         q=c;
         empty=false;
-      } else if ((c==L' ')||(c==L'\t')||(!c)) {//Teraz jest biały znak.
+      } else if ((c==' ')||(c=='\t')||(!c)) {//Teraz jest biały znak.
         if (!empty){//Token nie jest pusty.
-          std::string stoken;
-          ict::global::transferUTF(wtoken,stoken);
-          tokens[k++]=stoken;
-          wtoken.clear();
+          if (token.find('$')!=std::string::npos) tokensDynamic=true;
+          tokens.push(std::move(token));
+          token.clear();
           empty=true;
         }
       } else {//Nie jest to biały znak.
-        wtoken+=c;
+        token+=c;
         empty=false;
       }
     } else {//Był cudzysłów.
       if (q==c) {//Kończy się cudzysłów.
-        q=L'\0';
+        q='\0';
       } else {//Nie kończy się cudzysłów.
-        if (c) wtoken+=c;
+        if (c) token+=c;
       }
       empty=false;
     }
@@ -857,6 +2300,10 @@ int LineTokens::loadTokens(const Options & options){
   if (options.getVerbose()>LOG_DEBUG) debug()<<"Parsed tokens: "<<tokens<<std::endl;
   return(0);
 }
+void LineTokens::compileTokens(Tree & tree,Tree::node_t node) const {
+  if (tokensDynamic) tree.setFlag(node,Tree::flag_dynamic);
+  tree.addFrame(tokens);
+}
 //===========================================
 int LineInclude::parseLine(const Options & options){
   int out;
@@ -867,7 +2314,9 @@ int LineInclude::parseLine(const Options & options){
     return(__LINE__);
   }
   if (options.getVerbose()>LOG_NOTICE) notice()<<"Directive 'include' added: "<<tokens<<std::endl;
-  includedFile.reset(new LineFile(getThisPath(),tokens.at(0)));
+  Stats::phase(Stats::phase_link);
+  Trace::Span span("include",Trace::on()?("include "+tokens.get(0)):std::string());
+  includedFile.reset(new LineFile(getThisPath(),tokens.get(0)));
   if (includedFile){
     out=includedFile->parseLine(options);
     if (out) {
@@ -881,55 +2330,11 @@ int LineInclude::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineInclude::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  std::string begin;
-  std::string end;
-  line_list_t lines;
-  std::size_t c=0;
-  tokens_t tokens_local;
-  bool debug((!options.getStrip())&&(options.getVerbose()>LOG_DEBUG));
-  local_context.namesp=&namesp_in;
-  local_context.tokens=&tokens_in;
-  local_context.lines=&lines_in;
-  for (tokens_t::const_iterator it=tokens.cbegin();it!=tokens.cend();++it){
-    tokens_local[it->first]=replaceTokens(it->second,tokens_in);
-  }
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (debug){
-    if (comments_in){
-      begin="/* ";
-      end=" */";
-    } else {
-      begin="<!-- ";
-      end=" -->";
-    }
-    output<<space<<begin<<"Directive 'include' (start): "<<tokens_local<<end<<std::endl;
-  }
-  getChildren(lines);
-  if (includedFile){
-    c=includedFile->childrenCount();
-    out=includedFile->serializeChildren(options,output,namesp_in,tokens_local,lines,depth_in,comments_in);
-    if (out) {
-      info()<<"File included here."<<std::endl;
-      return(out);
-    }
-  } else {
-    error()<<"Internal error ("<<__FILE__<<":"<<__LINE__<<")!"<<std::endl;
-    return(__LINE__);
-  }
-  if (debug){
-    output<<space<<begin<<"Directive 'include' (stop,"<<c<<"): "<<tokens_local<<end<<std::endl;
-  }
-  local_context.namesp=nullptr;
-  local_context.tokens=nullptr;
-  local_context.lines=nullptr;
-  return(0);
+Tree::node_t LineInclude::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_include,parent,previous));
+  compileTokens(tree,n);
+  tree.addValue(getLinkedId());
+  return(n);
 }
 int LineInclude::dependences(const Options & options,std::ostream & output,Files::file_set_t & files,bool last){
   if (includedFile) return(includedFile->dependences(options,output,files,true));
@@ -940,27 +2345,22 @@ int LineNamespace::parseLine(const Options & options){
   int out;
   out=loadTokens(options);
   if (out) return(out);
-  for (tokens_t::const_iterator it=tokens.cbegin();it!=tokens.end();++it){
-    static std::wregex r(L"[a-zA-Z0-9_$]+",std::regex_constants::collate);
-    std::wsmatch match;
-    std::string stoken(it->second);
-    std::wstring wtoken;
-    ict::global::transferUTF(stoken,wtoken);
-    if (wtoken.front()==L'-'){
+  for (tokens_t::index_t i=0;i<tokens.size();i++){
+    const std::string & token(tokens.get(i));
+    if (token.size()&&(token.front()=='-')){
       root_namespace=true;
       namespace_names.clear();
     }
-    if (!testName(it->second)){
-      error()<<"Wrong name format in 'namespace' directive: "<<it->second<<" !"<<std::endl;
+    if (!testName(token)){
+      error()<<"Wrong name format in 'namespace' directive: "<<token<<" !"<<std::endl;
       return(__LINE__);
     }
-    if (std::regex_search(wtoken,match,r)){
-      for (const std::wstring m : match){
-        std::string sm;
-        std::wstring wm(m);
-        ict::global::transferUTF(wm,sm);
-        namespace_names.push_back(sm);
-      }
+    {//Dodawany jest pierwszy człon nazwy.
+      std::size_t b(0);
+      while ((b<token.size())&&(!isNameChar(token[b]))) b++;
+      std::size_t e(b);
+      while ((e<token.size())&&(isNameChar(token[e]))) e++;
+      if (b<e) namespace_names.push_back(token.substr(b,e-b));
     }
   }
   if (options.getVerbose()>LOG_NOTICE) {
@@ -973,42 +2373,12 @@ int LineNamespace::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineNamespace::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  std::string begin;
-  std::string end;
-  std::size_t c=childrenCount();
-  namespace_t namesp_tmp(namesp_in);
-  bool debug((!options.getStrip())&&(options.getVerbose()>LOG_DEBUG));
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (root_namespace) {
-    namesp_tmp=namespace_names;
-  } else {
-    for (const std::string n : namespace_names){
-      namesp_tmp.push_back(n);
-    }
-  }
-  if (debug){
-    if (comments_in){
-      begin="/* ";
-      end=" */";
-    } else {
-      begin="<!-- ";
-      end=" -->";
-    }
-    output<<space<<begin<<"Directive 'namespace' (start): "<<namesp_tmp<<end<<std::endl;
-  }
-  out=serializeChildren(options,output,namesp_tmp,tokens_in,lines_in,depth_in,comments_in);
-  if (out) return(out);
-  if (debug){
-    output<<space<<begin<<"Directive 'namespace' (stop,"<<c<<"): "<<namesp_tmp<<end<<std::endl;
-  }
-  return(0);
+Tree::node_t LineNamespace::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_namespace,parent,previous));
+  if (root_namespace) tree.setFlag(n,Tree::flag_root);
+  tree.addValue(namespace_names.size());
+  for (const std::string & name : namespace_names) tree.addString(name);
+  return(n);
 }
 //===========================================
 depth_t LineDefine::defCount=0;
@@ -1016,51 +2386,18 @@ int LineDefine::parseLine(const Options & options){
   int out;
   out=loadTokens(options);
   if (out) return(out);
-  for (tokens_t::const_iterator it=tokens.cbegin();it!=tokens.end();++it){
-    defined_names.push_back(it->second);
+  for (tokens_t::index_t i=0;i<tokens.size();i++){
+    defined_names.push_back(tokens.get(i));
   }
   if (options.getVerbose()>LOG_NOTICE) notice()<<"Directive 'define' added: "<<defined_names<<std::endl;
   line.clear();
   return(0);
 }
-int LineDefine::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  std::string space;
-  std::string begin;
-  std::string end;
-  std::size_t c=childrenCount();
-  bool debug((!options.getStrip())&&(options.getVerbose()>LOG_DEBUG));
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (debug){
-    if (comments_in){
-      begin="/* ";
-      end=" */";
-    } else {
-      begin="<!-- ";
-      end=" -->";
-    }
-    output<<space<<begin<<"Directive 'define' (start): "<<tokens_in<<end<<std::endl;
-  }
-  for (const std::string & n : defined_names){
-    std::string fullName(Names::fullName(namesp_in,n));
-    Line * ptr=Names::name2Line(fullName);
-    if (ptr){
-      if ((Names::name2id(fullName)!=fileId)||(Names::name2no(fullName)!=lineNo)){
-        error()<<"Name "<<fullName<<" registred twice! First definition: "<<ict::os::getRelativePath(Files::id2Path(Names::name2id(fullName)))<<":"<<Names::name2no(fullName)<<std::endl;
-        return(__LINE__);
-      }
-    } else {
-      Names::add(fullName,this,fileId,lineNo);
-      if (debug)  output<<space<<" "<<begin<<"Directive 'define' has registred new name: "<<fullName<<end<<std::endl;
-    }
-  }
-  if (debug){
-    output<<space<<begin<<"Directive 'define' (stop,"<<c<<"): "<<tokens_in<<end<<std::endl;
-  }
-  return(0);
+Tree::node_t LineDefine::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_define,parent,previous));
+  tree.addValue(defined_names.size());
+  for (const std::string & name : defined_names) tree.addString(name);
+  return(n);
 }
 //===========================================
 int LineClone::parseLine(const Options & options){
@@ -1071,132 +2408,34 @@ int LineClone::parseLine(const Options & options){
     error()<<"Name is missing in 'clone' directive!"<<std::endl;
     return(__LINE__);
   }
-  if (!testName(tokens.at(0))){
-    error()<<"Wrong name format in 'clone' directive: "<<tokens.at(0)<<" !"<<std::endl;
+  if (!testName(tokens.get(0))){
+    error()<<"Wrong name format in 'clone' directive: "<<tokens.get(0)<<" !"<<std::endl;
     return(__LINE__);
   }
   if (options.getVerbose()>LOG_NOTICE) notice()<<"Directive 'clone' added: "<<tokens<<std::endl;
   line.clear();
   return(0);
 }
-int LineClone::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  std::string begin;
-  std::string end;
-  std::size_t c=childrenCount();
-  line_list_t lines;
-  tokens_t tokens_local;
-  static std::regex r("[0-9]+");
-  bool debug((!options.getStrip())&&(options.getVerbose()>LOG_DEBUG));
-  local_context.namesp=&namesp_in;
-  local_context.tokens=&tokens_in;
-  local_context.lines=&lines_in;
-  for (tokens_t::const_iterator it=tokens.cbegin();it!=tokens.cend();++it){
-    tokens_local[it->first]=replaceTokens(it->second,tokens_in);
-  }
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (debug){
-    if (comments_in){
-      begin="/* ";
-      end=" */";
-    } else {
-      begin="<!-- ";
-      end=" -->";
-    }
-  }
-  getChildren(lines);
-  if (std::regex_match(tokens.at(0),r)){
-    std::size_t no=0;
-    local_context_t contex(local_context);
-    if (debug){
-      output<<space<<begin<<"Directive 'clone' (start): "<<(*(contex.tokens))<<end<<std::endl;
-    }
+Tree::node_t LineClone::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  std::size_t no=0;
+  Tree::node_t n(addNode(tree,Tree::kind_clone,parent,previous));
+  compileTokens(tree,n);
+  if (isNumber(tokens.get(0))){
+    tree.setFlag(n,Tree::flag_numeric);
     try{
-      no=std::stoull(tokens.at(0));
+      no=std::stoull(tokens.get(0));
     }catch(...){
       no=0;
     }
-    if (lines_in.size()){
-      Line * ptr=lines_in.at(0);
-      if (ptr){
-        local_context_t * c=ptr->getLocalContext();
-        if (c){
-          if (c->namesp) contex.namesp=c->namesp;
-          if (c->tokens) contex.tokens=c->tokens;
-          if (c->lines) contex.lines=c->lines;
-        }
-      }
-    }
-    if (no==0){
-      bool first=true;
-      for (Line * ptr : lines_in){
-        if (first){
-          first=false;
-        } else if (ptr){
-          out=ptr->serialize(options,output,*(contex.namesp),*(contex.tokens),*(contex.lines),depth_in,comments_in);
-          if (out) return(out);
-        }
-      }
-    } else if (lines_in.size()>no){
-      Line * ptr=lines_in.at(no);
-      if (ptr){
-        out=ptr->serialize(options,output,*(contex.namesp),*(contex.tokens),*(contex.lines),depth_in,comments_in);
-        if (out) return(out);
-      }
-    }
-    if (debug){
-      output<<space<<begin<<"Directive 'clone' (stop,"<<c<<"): "<<(*(contex.tokens))<<end<<std::endl;
-    }
-  } else {
-    Line * ptr=nullptr;
-    namespace_t namesp(namesp_in);
-    do {
-      std::string fullName(Names::fullName(namesp,tokens_local.at(0)));
-      ptr=Names::name2Line(fullName);
-      if (!ptr){
-        if (namesp.size()) {
-          namesp.pop_back();
-        } else {
-          break;
-        }
-      }
-    } while(!ptr);
-    if (debug){
-      output<<space<<begin<<"Directive 'clone' (start): "<<tokens_local<<end<<std::endl;
-    }
-    if (ptr){
-       out=ptr->serializeChildren(options,output,namesp_in,tokens_local,lines,depth_in,comments_in);
-       if (out) return(out);
-    } else {
-      error()<<"Name "<<Names::fullName(namesp_in,tokens_local.at(0))<<" not found!"<<std::endl;
-      return(__LINE__);
-    }
-    if (debug){
-      output<<space<<begin<<"Directive 'clone' (stop,"<<c<<"): "<<tokens_local<<end<<std::endl;
-    }
   }
-  local_context.namesp=nullptr;
-  local_context.tokens=nullptr;
-  local_context.lines=nullptr;
-  return(0);
+  tree.addValue((no<Tree::none)?no:Tree::none);
+  return(n);
 }
 //===========================================
 int LineText::parseLine(const Options & options){
-  static std::wregex r(L"-[ \\t]*(.*)");
-  std::wsmatch match;
-  std::string sline(line);
-  std::wstring wline;
-  ict::global::transferUTF(sline,wline);
-  if ((std::regex_match(wline,match,r))&&(match.size()>1)) {
-    std::string stext;
-    std::wstring wtext(match[1]);
-    ict::global::transferUTF(wtext,stext);
-    textLine=stext;
+  static const std::string lead("-");
+  if (!line.compare(0,lead.size(),lead)) {
+    textLine.assign(line,skipBlanks(line,lead.size()),std::string::npos);
   } else {
     error()<<"Internal parsing error !"<<std::endl;
     return(__LINE__);
@@ -1205,31 +2444,16 @@ int LineText::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineText::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  output<<space<<encodeHtml(replaceTokens(textLine,tokens_in))<<std::endl;
-  out=serializeChildren(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in);
-  if (out) return(out);
-  return(0);
+Tree::node_t LineText::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_text,parent,previous));
+  tree.addString(textLine);
+  return(n);
 }
 //===========================================
 int LineHtml::parseLine(const Options & options){
-  static std::wregex r(L"=[ \\t]*(.*)");
-  std::wsmatch match;
-  std::string sline(line);
-  std::wstring wline;
-  ict::global::transferUTF(sline,wline);
-  if ((std::regex_match(wline,match,r))&&(match.size()>1)) {
-    std::string shtml;
-    std::wstring whtml(match[1]);
-    ict::global::transferUTF(whtml,shtml);
-    htmlLine=shtml;
+  static const std::string lead("=");
+  if (!line.compare(0,lead.size(),lead)) {
+    htmlLine.assign(line,skipBlanks(line,lead.size()),std::string::npos);
   } else {
     error()<<"Internal parsing error !"<<std::endl;
     return(__LINE__);
@@ -1238,31 +2462,16 @@ int LineHtml::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineHtml::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  output<<space<<replaceTokens(htmlLine,tokens_in)<<std::endl;
-  out=serializeChildren(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in);
-  if (out) return(out);
-  return(0);
+Tree::node_t LineHtml::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_html,parent,previous));
+  tree.addString(htmlLine);
+  return(n);
 }
 //===========================================
 int LineComment::parseLine(const Options & options){
-  static std::wregex r(L"/[ \\t]*(.*)");
-  std::wsmatch match;
-  std::string sline(line);
-  std::wstring wline;
-  ict::global::transferUTF(sline,wline);
-  if ((std::regex_match(wline,match,r))&&(match.size()>1)) {
-    std::string scomment;
-    std::wstring wcomment(match[1]);
-    ict::global::transferUTF(wcomment,scomment);
-    commentLine=scomment;
+  static const std::string lead("/");
+  if (!line.compare(0,lead.size(),lead)) {
+    commentLine.assign(line,skipBlanks(line,lead.size()),std::string::npos);
   } else {
     error()<<"Internal parsing error !"<<std::endl;
     return(__LINE__);
@@ -1271,93 +2480,75 @@ int LineComment::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineComment::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  int out;
-  std::string space;
-  std::string begin;
-  std::string end;
-  std::size_t c=childrenCount();
-  if (options.getStrip()) return(0);
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (comments_in){
-    begin="/* ";
-    end=" */";
-  } else {
-    begin="<!-- ";
-    end=" -->";
-  }
-  output<<space<<begin<<replaceTokens(commentLine,tokens_in);
-  if (c){
-    output<<std::endl;
-    out=serializeChildren(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in+1);
-    if (out) return(out);
-    output<<space;
-  }
-  output<<end<<std::endl;
-  return(0);
+Tree::node_t LineComment::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_comment,parent,previous));
+  tree.addString(commentLine);
+  return(n);
 }
 //===========================================
 int LineMock::parseLine(const Options & options){
-  static std::wregex r(L"//[ \\t]*(.*)");
-  std::wsmatch match;
-  std::string sline(line);
-  std::wstring wline;
-  std::wstring commentLine;
-  ict::global::transferUTF(sline,wline);
-  if ((std::regex_match(wline,match,r))&&(match.size()>1)) {
-    commentLine=match[1];
+  static const std::string lead("//");
+  std::size_t size=0;
+  if (!line.compare(0,lead.size(),lead)) {
+    //Rozmiar w znakach (nie w bajtach UTF-8).
+    for (std::size_t i=skipBlanks(line,lead.size());i<line.size();i++) if ((line[i]&0xC0)!=0x80) size++;
   } else {
     error()<<"Internal parsing error !"<<std::endl;
     return(__LINE__);
   }
-  if (options.getVerbose()>LOG_NOTICE) notice()<<"Comment ignored (size): "<<commentLine.size()<<std::endl;
+  if (options.getVerbose()>LOG_NOTICE) notice()<<"Comment ignored (size): "<<size<<std::endl;
   line.clear();
   return(0);
 }
-int LineMock::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
-  return(0);
+Tree::node_t LineMock::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  //Dzieci komentarza nie są serializowane, ale są zapisywane w drzewie (dołączają pliki w kolejności parsowania).
+  return(addNode(tree,Tree::kind_mock,parent,previous));
 }
 //===========================================
-LineNode::stage_t LineNode::ctrlChar(stage_t stage,wchar_t c){
-  switch (c){
-    case L'~':no_short=true;
-    case L' ':case L'\t':case L'\0':return(stage_space);
-    default:break;
-  }
-  switch (stage){
-    case stage_tag:case stage_class: switch (c){
-      case L'.': return(stage_class);
-      case L'#': return(stage_id);
-      case L'(': return(stage_attr_name);
-      default:break;
-    } break;
-    case stage_id:switch (c){
-      case L'(': return(stage_attr_name);
-      default:break;
-    } break;
-    case stage_attr_name: switch (c){
-      case L'=': return(stage_attr_value);
-      case L',': return(stage_attr_name);
-      case L')': return(stage_space);
-      default:break;
-    } break;
-    case stage_attr_value: switch (c){
-      case L',': return(stage_attr_name);
-      case L')': return(stage_space);
-      default:break;
-    } break;
-    default:break;
-  }
-  return(stage_start);
-}
+#define C_O LineNode::char_other
+#define C_B LineNode::char_blank
+const std::uint8_t LineNode::charClass[256]={
+  //0x00-0x1F: '\0' i '\t' są rozróżniane.
+  LineNode::char_nul,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_B,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  //0x20-0x2F: ' ' '"' '#' '\'' '(' ')' ',' '.'
+  C_B,C_O,LineNode::char_quote,LineNode::char_hash,C_O,C_O,C_O,LineNode::char_quote,
+  LineNode::char_open,LineNode::char_close,C_O,C_O,LineNode::char_comma,C_O,LineNode::char_dot,C_O,
+  //0x30-0x3F: '='
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,LineNode::char_equal,C_O,C_O,
+  //0x40-0x5F: '\\'
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,LineNode::char_escape,C_O,C_O,C_O,
+  //0x60-0x7F: '~'
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,LineNode::char_tilde,C_O,
+  //0x80-0xFF: bajty znaków wielobajtowych.
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,
+  C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O,C_O
+};
+#undef C_O
+#undef C_B
+#define S_0 LineNode::stage_start
+#define S_S LineNode::stage_space
+const std::uint8_t LineNode::ctrlTable[LineNode::stage_count][LineNode::char_class_count]={
+  //other, blank, nul, tilde, dot, hash, open, close, equal, comma, quote, escape
+  {S_0,S_S,S_S,S_S,S_0,S_0,S_0,S_0,S_0,S_0,S_0,S_0},//stage_start
+  {S_0,S_S,S_S,S_S,LineNode::stage_class,LineNode::stage_id,LineNode::stage_attr_name,S_0,S_0,S_0,S_0,S_0},//stage_tag
+  {S_0,S_S,S_S,S_S,LineNode::stage_class,LineNode::stage_id,LineNode::stage_attr_name,S_0,S_0,S_0,S_0,S_0},//stage_class
+  {S_0,S_S,S_S,S_S,S_0,S_0,LineNode::stage_attr_name,S_0,S_0,S_0,S_0,S_0},//stage_id
+  {S_0,S_S,S_S,S_S,S_0,S_0,S_0,S_S,LineNode::stage_attr_value,LineNode::stage_attr_name,S_0,S_0},//stage_attr_name
+  {S_0,S_S,S_S,S_S,S_0,S_0,S_0,S_S,S_0,LineNode::stage_attr_name,S_0,S_0},//stage_attr_value
+  {S_0,S_S,S_S,S_S,S_0,S_0,S_0,S_0,S_0,S_0,S_0,S_0},//stage_space
+  {S_0,S_S,S_S,S_S,S_0,S_0,S_0,S_0,S_0,S_0,S_0,S_0}//stage_text
+};
+#undef S_0
+#undef S_S
 void LineNode::saveToken(stage_t stage,const std::string & token,std::string & attrName){
   switch(stage){
     case stage_tag:
@@ -1384,113 +2575,123 @@ void LineNode::saveToken(stage_t stage,const std::string & token,std::string & a
     default:break;
   }
 }
-std::string LineNode::getAttr(const namespace_t & namesp_in,const tokens_t & tokens_in){
-  std::string out;
-  attr_t a(attr);
-  for (const std::string & c : class_names){
-    if (c.size()) {
-      const static std::string class_str("class");
-      if (a.count(class_str)) a[class_str]+=' ';
-      a[class_str]+=Names::fullName(namesp_in,c);
-    }
-  }
-  if (id.size()) a["id"]=Names::fullName(namesp_in,id);
-  for (attr_t::const_iterator it=a.cbegin();it!=a.cend();++it){
-    out+=' ';
-    out+=encodeHtml(replaceTokens(it->first,tokens_in));
-    if (it->second.size()){
-      out+='=';
-      out+='"';
-      out+=encodeHtml(replaceTokens(it->second,tokens_in));
-      out+='"';
-    }
-  }
-  return(out);
-}
-int LineNode::loadAll(const Options & options){
-  std::size_t k=0;
-  wchar_t q(L'\0');
-  wchar_t l(L'\0');
-  std::wstring wtoken;
+int LineNode::loadAll(){
+  //Token jest zapamiętany jako zakres [begin,end) linii - kopia powstaje tylko dla cudzysłowów i znaków ucieczki.
+  const std::size_t npos(std::string::npos);
+  const std::size_t size(line.size());
+  std::size_t begin(npos);
+  std::size_t end(npos);
+  std::size_t text(npos);
+  bool copied=false;
+  std::string buffer;
   std::string attrName;
+  char q('\0');
+  char l('\0');
   bool empty=true;
   stage_t stage_now(stage_start);
-  stage_t stage_next(stage_start);
-  std::string sline(line);
-  std::wstring wline;
-  std::wstring wtext;
-  ict::global::transferUTF(sline,wline);
-  wline+=L'\0';
-  for (wchar_t c : wline){
-    if (stage_now==stage_start){//Jeśli to początek
-      switch(c){
-        case L' ':case L'\t':case L'\0':
-          break;
-        default:
-          stage_now=stage_tag;
-          if (c) wtoken+=c;
+  #define LINE_NODE_COPY \
+    if (!copied){ \
+      if (begin!=npos) buffer.assign(line,begin,end-begin); \
+      copied=true; \
+    }
+  #define LINE_NODE_APPEND(c) \
+    if (copied) { \
+      buffer+=(c); \
+    } else if (begin==npos) { \
+      begin=i; \
+      end=i+1; \
+    } else { \
+      end++; \
+    }
+  for (std::size_t i=0;i<=size;i++){//Znak '\0' na końcu zamyka ostatni token.
+    const char c((i<size)?line[i]:'\0');
+    const char_class_t k((char_class_t)charClass[(std::uint8_t)c]);
+    switch (stage_now){
+      case stage_start://Jeśli to początek
+        switch(k){
+          case char_blank:case char_nul:
+            break;
+          default:
+            stage_now=stage_tag;
+            LINE_NODE_APPEND(c)
+            empty=false;
+            break;
+        }
+        break;
+      case stage_text://Jeśli to już jest tekst
+        break;
+      case stage_space://Jeśli to jest przerwa pomiędzy definicją taga a tekstem.
+        if ((k==char_tilde)&&(l!=' ')&&(l!='\t')&&(!no_short)){
+          no_short=true;
+        } else switch(k){
+          case char_blank:case char_nul:
+            break;
+          default:
+            stage_now=stage_text;
+            text=i;
+            break;
+        }
+        break;
+      default:
+        if (l=='\\'){//Poprzednio był znak ucieczki.
+          LINE_NODE_COPY
+          switch(c){
+            case '\0':break;
+            case 'n' :buffer+='\n';break;
+            case 'r' :buffer+='\r';break;
+            case 't' :buffer+='\t';break;
+            case 'v' :buffer+='\v';break;
+            case '0' :buffer+='\0';break;
+            default:buffer+=c;break;
+          }
+          empty=false;
+        } else if (k==char_escape) {//Teraz jest znak ucieczki.
+          LINE_NODE_COPY
+          empty=false;
+        } else if (q=='\0'){//Nie było cudzysłowa.
+          const stage_t stage_next((stage_t)ctrlTable[stage_now][k]);
+          if (k==char_quote) {//Zaczyna się cudzysłów.
+            LINE_NODE_COPY
+            q=c;
+            empty=false;
+          } else if (stage_next!=stage_start) {//Teraz jest znak sterujący.
+            if (k==char_tilde) no_short=true;
+            if (!empty){//Token nie jest pusty.
+              saveToken(stage_now,copied?buffer:((begin==npos)?std::string():line.substr(begin,end-begin)),attrName);
+              buffer.clear();
+              copied=false;
+              begin=npos;
+              empty=true;
+            }
+            stage_now=stage_next;
+          } else {//Nie jest to znak sterujący.
+            LINE_NODE_APPEND(c)
+            empty=false;
+          }
+        } else {//Był cudzysłów.
+          LINE_NODE_COPY
+          if (q==c) {//Kończy się cudzysłów.
+            q='\0';
+          } else {//Nie kończy się cudzysłów.
+            if (c) buffer+=c;
+          }
           empty=false;
-          break;
-      }
-    } else if (stage_now==stage_text){//Jeśli to już jest tekst
-      if (c) wtext+=c;
-    } else if (stage_now==stage_space){//Jeśli to jest przerwa pomiędzy definicją taga a tekstem.
-      if ((c==L'~')&&(l!=L' ')&&(l!=L'\t')&&(!no_short)){
-        no_short=true;
-      } else switch(c){
-        case L' ':case L'\t':case L'\0':
-          break;
-        default:
-          stage_now=stage_text;
-          wtext+=c;
-          break;
-      }
-    } else if (l==L'\\'){//Poprzednio był znak ucieczki.
-      switch(c){
-        case L'\0':break;
-        case L'n' :wtoken+=L'\n';break;
-        case L'r' :wtoken+=L'\r';break;
-        case L't' :wtoken+=L'\t';break;
-        case L'v' :wtoken+=L'\v';break;
-        case L'0' :wtoken+=L'\0';break;
-        default:wtoken+=c;break;
-      }
-      empty=false;
-    } else if (c=='\\') {//Teraz jest znak ucieczki.
-      empty=false;
-    } else if (q=='\0'){//Nie było cudzysłowa.
-      if ((c=='"')||(c=='\'')) {//Zaczyna się cudzysłów.
-        q=c;
-        empty=false;
-      } else if (stage_next=ctrlChar(stage_now,c)) {//Teraz jest znak sterujący.
-        if (!empty){//Token nie jest pusty.
-          std::string stoken;
-          ict::global::transferUTF(wtoken,stoken);
-          saveToken(stage_now,stoken,attrName);
-          wtoken.clear();
-          empty=true;
         }
-        stage_now=stage_next;
-      } else {//Nie jest to znak sterujący.
-        if (c) wtoken+=c;
-        empty=false;
-      }
-    } else {//Był cudzysłów.
-      if (q==c) {//Kończy się cudzysłów.
-        q=L'\0';
-      } else {//Nie kończy się cudzysłów.
-        if (c) wtoken+=c;
-      }
-      empty=false;
+        break;
     }
     l=c;
   }
-  ict::global::transferUTF(wtext,textLine);
+  #undef LINE_NODE_COPY
+  #undef LINE_NODE_APPEND
+  if (text!=npos){
+    textLine.assign(line,text,npos);
+    if (textLine.find('\0')!=npos) textLine.erase(std::remove(textLine.begin(),textLine.end(),'\0'),textLine.end());
+  }
   return(0);
 }
 int LineNode::parseLine(const Options & options){
   int out;
-  out=loadAll(options);
+  out=loadAll();
   if (out) return(out);
   if (!tag.size()) tag=options.getDefaultTag();
   if (options.getVerbose()>LOG_NOTICE) 
@@ -1498,52 +2699,793 @@ int LineNode::parseLine(const Options & options){
   line.clear();
   return(0);
 }
-int LineNode::serialize(
-  const Options & options,std::ostream & output,
-  const namespace_t & namesp_in,const tokens_t & tokens_in,const line_list_t & lines_in,
-  depth_t depth_in,depth_t comments_in
-){
+Tree::node_t LineNode::compile(Tree & tree,Tree::node_t parent,Tree::node_t previous) const {
+  Tree::node_t n(addNode(tree,Tree::kind_node,parent,previous));
+  if (no_short) tree.setFlag(n,Tree::flag_no_short);
+  tree.addValue(class_names.size());
+  tree.addValue(attr.size());
+  tree.addString(tag);
+  tree.addString(textLine);
+  tree.addString(id);
+  for (const std::string & c : class_names) tree.addString(c);
+  for (attr_t::const_iterator it=attr.cbegin();it!=attr.cend();++it){
+    tree.addString(it->first);
+    tree.addString(it->second);
+  }
+  return(n);
+}
+//===========================================
+//! Napis z podstawionymi tokenami (html - także z kodowaniem HTML).
+struct TokenText {const std::string & text;const tokens_t & tokens;bool html;};
+//! Wcięcie (liczba spacji).
+struct Indent {std::size_t size;};
+//!
+//! Wyjście serializacji - zapis do strumienia albo, w estymacji (R::measure), tylko liczenie bajtów bez tworzenia napisów.
+//!
+template<class R> class Writer {
+private:
+  std::ostream & output;
+  std::uint64_t count;
+public:
+  Writer(std::ostream & output_in):output(output_in),count(0){}
+  //! Estymacja: liczba bajtów zapisanych do tej pory.
+  std::uint64_t size() const {return(count);}
+  void add(std::uint64_t size_in){count+=size_in;}
+  Writer & operator<<(const std::string & v){
+    if (R::measure) count+=v.size(); else output<<v;
+    return(*this);
+  }
+  Writer & operator<<(const char * v){
+    if (R::measure) count+=std::strlen(v); else output<<v;
+    return(*this);
+  }
+  Writer & operator<<(const TokenText & v){
+    if (R::measure) {
+      count+=tokensSize(v.text,v.tokens,v.html);
+    } else if (v.html) {
+      output<<encodeHtml(replaceTokens(v.text,v.tokens));
+    } else {
+      output<<replaceTokens(v.text,v.tokens);
+    }
+    return(*this);
+  }
+  Writer & operator<<(const Indent & v){
+    static const std::string spaces(256,' ');
+    if (R::measure) {
+      count+=v.size;
+    } else {
+      for (std::size_t i=v.size;i;){
+        const std::size_t n(std::min(i,spaces.size()));
+        output.write(spaces.data(),n);
+        i-=n;
+      }
+    }
+    return(*this);
+  }
+  //! Tylko std::endl.
+  Writer & operator<<(std::ostream & (*m)(std::ostream &)){
+    if (R::measure) count++; else output<<m;
+    return(*this);
+  }
+  //! Pozostałe wartości (liczby, ramki tokenów, przestrzenie nazw) - tylko w komunikatach diagnostycznych (-vvvv).
+  template<class T> Writer & operator<<(const T & v){
+    if (R::measure) {
+      CountBuf buffer(nullptr);
+      std::ostream counted(&buffer);
+      counted<<v;
+      count+=buffer.size();
+    } else {
+      output<<v;
+    }
+    return(*this);
+  }
+};
+//!
+//! Serializacja zwartych drzew (Tree) dla podanej polityki. 
+//! Rodzaj węzła jest wybierany w instrukcji switch - bez wywołań metod wirtualnych.
+//! Zamiast rekurencji używany jest jawny stos (głębokość ogranicza tylko --max-depth).
+//!
+template<class R> class Renderer {
+public:
+  //! Kontekst serializacji.
+  struct scope_t {
+    const namespace_t * namesp;
+    const tokens_t * tokens;
+    //! Dyrektywa 'include' lub 'clone', której dzieci są dostępne dla 'clone <numer>'.
+    const Tree * tree;
+    Tree::node_t owner;
+    //! Kontekst, w którym serializowana jest dyrektywa 'owner'.
+    const scope_t * outer;
+    //! Estymacja: identyfikator zawartości kontekstu (scopeId()).
+    std::uint64_t id;
+  };
+  //! Akcja wykonywana po serializacji dzieci.
+  enum close_t {
+    close_none,
+    close_tag,
+    close_comment,
+    close_include,
+    close_namespace,
+    close_clone,
+    close_numeric
+  };
+  //! Element stosu - węzeł, którego dzieci są serializowane.
+  struct frame_t {
+    close_t close;
+    //! Węzeł (dyrektywa lub tag), który otworzył ramkę.
+    const Tree * tree;
+    Tree::node_t node;
+    depth_t depth;
+    depth_t comments;
+    //! Lista serializowanych dzieci.
+    const Tree * list;
+    Tree::node_t next;
+    bool single;
+    depth_t childDepth;
+    depth_t childComments;
+    //! Kontekst dzieci (może wskazywać na 'namesp' i 'tokens' tej ramki).
+    scope_t scope;
+    namespace_t namesp;
+    tokens_t tokens;
+    //! Estymacja: klucz rozwinięcia 'clone' i rozmiar wyjścia przy otwarciu ramki.
+    std::string memo;
+    std::uint64_t start;
+  };
+private:
+  const Options & options;
+  std::ostream & output;
+  Writer<R> sink;
+  //! Estymacja: limit rozmiaru (0 - bez limitu), rozmiary rozwinięć 'clone' według klucza (blok, kontekst, głębokość) i identyfikatory kontekstów.
+  std::uint64_t limit;
+  std::map<std::string,std::uint64_t> memo;
+  std::map<std::string,std::uint64_t> scopes;
+  //! Estymacja: identyfikator kontekstu - konteksty o tej samej zawartości (przestrzeń nazw, tokeny, dyrektywa 'owner' i jej kontekst) mają ten sam identyfikator.
+  std::uint64_t scopeId(const scope_t & scope);
+  std::string memoKey(std::uint64_t scope_in,const Tree * tree,Tree::node_t n,depth_t depth_in,depth_t comments_in);
+  //! Pliki już dołączone (w kolejności parsowania).
+  Files::file_set_t linkedFiles;
+  //! Dyrektywy 'include', które dołączają plik - każdy plik jest dołączany tylko raz (jak podczas parsowania).
+  std::set<std::pair<const Tree *,Tree::node_t>> linked;
+  //! Stos ramek (std::deque - dodanie ramki nie unieważnia wskaźników do pozostałych).
+  std::deque<frame_t> stack;
+  void marks(depth_t comments_in,std::string & begin,std::string & end);
+  void bindTokens(const Tree & tree,Tree::node_t n,const tokens_t & tokens_in,tokens_t & tokens_out);
+  //! W estymacji atrybuty są tylko liczone (napis jest pusty).
+  void addAttr(std::string & out,const std::string & name,const std::string & value,const tokens_t & tokens_in);
+  std::string getAttr(const Tree & tree,Tree::node_t n,const namespace_t & namesp_in,const tokens_t & tokens_in);
+  int enter(const Tree & list,Tree::node_t n,depth_t depth_in);
+  frame_t & push(close_t close_in,const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  void close(frame_t & f);
+  void unwind();
+  int run();
+  int node(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int include(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int namesp(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int define(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int clone(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int text(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int html(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int comment(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+  int tag(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in);
+public:
+  Renderer(const Options & options_in,std::ostream & output_in,std::uint64_t limit_in=0):options(options_in),output(output_in),sink(output_in),limit(limit_in){}
+  void link(Files::file_id_t id);
+  int file(Files::file_id_t id);
+  //! Estymacja (R::measure): rozmiar wyjścia.
+  std::uint64_t measured() const {return(sink.size());}
+};
+template<class R> void Renderer<R>::marks(depth_t comments_in,std::string & begin,std::string & end){
+  if (comments_in){
+    begin="/* ";
+    end=" */";
+  } else {
+    begin="<!-- ";
+    end=" -->";
+  }
+}
+template<class R> void Renderer<R>::bindTokens(const Tree & tree,Tree::node_t n,const tokens_t & tokens_in,tokens_t & tokens_out){
+  const tokens_t & tokens(tree.frame(n,0));
+  if (!tree.flag(n,Tree::flag_dynamic)){//Brak tokenów do podstawienia - ramka jest współdzielona.
+    tokens_out=tokens;
+    return;
+  }
+  tokens_out=tokens_t(tokens.size());
+  for (tokens_t::index_t i=0;i<tokens.size();i++){
+    tokens_out.push(replaceTokens(tokens.get(i),tokens_in));
+  }
+}
+template<class R> void Renderer<R>::addAttr(std::string & out,const std::string & name,const std::string & value,const tokens_t & tokens_in){
+  if (R::measure) {
+    sink.add(1+tokensSize(name,tokens_in,true)+(value.size()?(3+tokensSize(value,tokens_in,true)):0));
+    return;
+  }
+  out+=' ';
+  out+=encodeHtml(replaceTokens(name,tokens_in));
+  if (value.size()){
+    out+='=';
+    out+='"';
+    out+=encodeHtml(replaceTokens(value,tokens_in));
+    out+='"';
+  }
+}
+template<class R> std::string Renderer<R>::getAttr(const Tree & tree,Tree::node_t n,const namespace_t & namesp_in,const tokens_t & tokens_in){
+  const static std::string class_str("class");
+  const static std::string id_str("id");
+  std::string out;
+  const Tree::index_t classes(tree.value(n,0));
+  const Tree::index_t attrs(tree.value(n,1));
+  const Tree::index_t first_attr(5+classes);
+  const std::string & id(tree.string(n,4));
+  bool class_set=false;
+  bool id_set=false;
+  std::string class_value;
+  std::string id_value;
+  //Atrybuty 'class' i 'id' łączą wartości jawne z nazwami klas i identyfikatorem.
+  for (Tree::index_t i=0;i<attrs;i++){
+    const std::string & name(tree.string(n,first_attr+2*i));
+    if (name==class_str){
+      class_set=true;
+      class_value=tree.string(n,first_attr+2*i+1);
+    } else if (name==id_str){
+      id_set=true;
+      id_value=tree.string(n,first_attr+2*i+1);
+    }
+  }
+  for (Tree::index_t i=0;i<classes;i++){
+    const std::string & c(tree.string(n,5+i));
+    if (c.size()) {
+      if (class_set) class_value+=' ';
+      class_value+=Names::fullName(namesp_in,c);
+      class_set=true;
+    }
+  }
+  if (id.size()) {
+    id_set=true;
+    id_value=Names::fullName(namesp_in,id);
+  }
+  //Atrybuty są posortowane - 'class' i 'id' są wstawiane we właściwe miejsca.
+  for (Tree::index_t i=0;i<attrs;i++){
+    const std::string & name(tree.string(n,first_attr+2*i));
+    if (class_set&&(class_str<name)){
+      addAttr(out,class_str,class_value,tokens_in);
+      class_set=false;
+    }
+    if (id_set&&(id_str<name)){
+      addAttr(out,id_str,id_value,tokens_in);
+      id_set=false;
+    }
+    if (name==class_str){
+      addAttr(out,class_str,class_value,tokens_in);
+      class_set=false;
+    } else if (name==id_str){
+      addAttr(out,id_str,id_value,tokens_in);
+      id_set=false;
+    } else {
+      addAttr(out,name,tree.string(n,first_attr+2*i+1),tokens_in);
+    }
+  }
+  if (class_set) addAttr(out,class_str,class_value,tokens_in);
+  if (id_set) addAttr(out,id_str,id_value,tokens_in);
+  return(out);
+}
+template<class R> int Renderer<R>::enter(const Tree & list,Tree::node_t n,depth_t depth_in){
+  if (!options.testMaxDepth(depth_in)){
+    list.log(n,"error")<<"Max depth reached ("<<options.getMaxDepth()<<") - change --max-depth param!"<<std::endl;
+    return(__LINE__);
+  }
+  return(0);
+}
+template<class R> std::uint64_t Renderer<R>::scopeId(const scope_t & scope){
+  std::string key;
+  const Tree * t(scope.tree);
+  key.append((const char *)&t,sizeof(t));
+  for (const std::uint64_t v : {std::uint64_t(scope.owner),std::uint64_t(scope.outer?scope.outer->id:0),std::uint64_t(scope.namesp->size()),std::uint64_t(scope.tokens->size())}) key.append((const char *)&v,sizeof(v));
+  for (const std::string & i : *scope.namesp) {
+    const std::uint64_t l(i.size());
+    key.append((const char *)&l,sizeof(l));
+    key+=i;
+  }
+  for (tokens_t::index_t i=0;i<scope.tokens->size();i++) {
+    const std::uint64_t l(scope.tokens->has(i)?scope.tokens->get(i).size():std::uint64_t(-1));
+    key.append((const char *)&l,sizeof(l));
+    key+=scope.tokens->get(i);
+  }
+  return(scopes.emplace(std::move(key),scopes.size()+1).first->second);
+}
+template<class R> std::string Renderer<R>::memoKey(std::uint64_t scope_in,const Tree * tree,Tree::node_t n,depth_t depth_in,depth_t comments_in){
+  std::string out;
+  out.append((const char *)&tree,sizeof(tree));
+  //Liczba nazw - rozwinięcie mogło zależeć od nazw zdefiniowanych wcześniej (nazwy są tylko dodawane).
+  for (const std::uint64_t v : {scope_in,std::uint64_t(n),std::uint64_t(depth_in),std::uint64_t(comments_in),std::uint64_t(Names::size())}) out.append((const char *)&v,sizeof(v));
+  return(out);
+}
+template<class R> typename Renderer<R>::frame_t & Renderer<R>::push(close_t close_in,const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  stack.emplace_back();
+  frame_t & f(stack.back());
+  f.close=close_in;
+  f.tree=&tree;
+  f.node=n;
+  f.depth=depth_in;
+  f.comments=comments_in;
+  f.list=&tree;
+  f.next=tree.first(n);
+  f.single=false;
+  f.childDepth=depth_in+1;
+  f.childComments=comments_in;
+  f.scope=scope;
+  return(f);
+}
+template<class R> void Renderer<R>::close(frame_t & f){
+  const Tree & tree(*f.tree);
+  std::string begin;
+  std::string end;
+  if (f.close==close_none) return;
+  const Indent space{R::indent?std::size_t(f.depth?(f.depth-1):0):0};
+  marks(f.comments,begin,end);
+  switch (f.close){
+    case close_tag:
+      sink<<space<<"</"<<TokenText{tree.string(f.node,2),*f.scope.tokens,true}<<">"<<std::endl;
+      break;
+    case close_comment:
+      sink<<space<<end<<std::endl;
+      break;
+    case close_include:
+      if (R::debug) sink<<space<<begin<<"Directive 'include' (stop,"<<f.list->childrenCount(0)<<"): "<<f.tokens<<end<<std::endl;
+      break;
+    case close_namespace:
+      if (R::debug) sink<<space<<begin<<"Directive 'namespace' (stop,"<<tree.childrenCount(f.node)<<"): "<<f.namesp<<end<<std::endl;
+      break;
+    case close_clone:
+      if (R::debug) sink<<space<<begin<<"Directive 'clone' (stop,"<<tree.childrenCount(f.node)<<"): "<<f.tokens<<end<<std::endl;
+      break;
+    case close_numeric:
+      if (R::debug) sink<<space<<begin<<"Directive 'clone' (stop,"<<tree.childrenCount(f.node)<<"): "<<(*f.scope.tokens)<<end<<std::endl;
+      break;
+    default:break;
+  }
+}
+template<class R> void Renderer<R>::unwind(){
+  while (stack.size()){
+    const frame_t & f(stack.back());
+    if (f.close==close_include) f.tree->log(f.node,"info")<<"File included here."<<std::endl;
+    stack.pop_back();
+  }
+}
+template<class R> int Renderer<R>::run(){
   int out;
-  std::string space;
-  std::size_t c=childrenCount();
-  if (!options.getStrip()) space.append(depth_in?(depth_in-1):0,' ');
-  if (textLine.size()||c||no_short){
-    output<<space<<"<"<<encodeHtml(replaceTokens(tag,tokens_in))<<getAttr(namesp_in,tokens_in)<<">"<<encodeHtml(replaceTokens(textLine,tokens_in));
-    if (c) output<<std::endl;
-    out=serializeChildren(options,output,namesp_in,tokens_in,lines_in,depth_in,comments_in);
-    if (out) return(out);
-    if (c) output<<space;
-    output<<"</"<<encodeHtml(replaceTokens(tag,tokens_in))<<">"<<std::endl;
+  while (stack.size()){
+    frame_t & f(stack.back());
+    Tree::node_t c(f.next);
+    if (c==Tree::none){
+      if (R::profile&&(f.close!=close_none)){
+        const std::uint64_t start(Profile::clock());
+        const std::streamoff position(output.tellp());
+        close(f);
+        Profile::add(Profile::depth(),*f.tree,f.node,Profile::clock()-start,std::streamoff(output.tellp())-position,false);
+        if ((f.close==close_include)||(f.close==close_clone)) Profile::pop();
+      } else {
+        close(f);
+      }
+      if (R::measure) {
+        if (f.memo.size()) memo[std::move(f.memo)]=measured()-f.start;
+      } else {
+        if (Trace::on()&&((f.close==close_include)||(f.close==close_clone)||(f.close==close_numeric))) Trace::end();
+        if (f.close==close_include) ICT_PROBE(dorothy,include_end,f.tokens.get(0).c_str(),f.list->getFileId());
+        if ((f.close==close_clone)||(f.close==close_numeric)) ICT_PROBE(dorothy,clone_end,f.tree->getFileId(),f.tree->lineNo(f.node));
+      }
+      stack.pop_back();
+      continue;
+    }
+    f.next=f.single?Tree::none:f.list->next(c);
+    if (R::profile){//Koszt węzła bez dzieci - dzieci są serializowane w kolejnych krokach pętli.
+      const Tree & list(*f.list);
+      const std::size_t depth(Profile::depth());
+      const std::uint64_t start(Profile::clock());
+      const std::streamoff position(output.tellp());
+      out=node(list,c,f.scope,f.childDepth,f.childComments);
+      Profile::add(depth,list,c,Profile::clock()-start,std::streamoff(output.tellp())-position,true);
+    } else {
+      out=node(*f.list,c,f.scope,f.childDepth,f.childComments);
+    }
+    if (R::measure&&limit&&(!out)&&(measured()>limit)) out=__LINE__;//Limit przekroczony - estymacja jest przerywana.
+    if (out) {
+      unwind();
+      return(out);
+    }
+  }
+  return(0);
+}
+template<class R> int Renderer<R>::node(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  switch (tree.kind(n)){
+    case Tree::kind_include:return(include(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_namespace:return(namesp(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_define:return(define(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_clone:return(clone(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_text:return(text(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_html:return(html(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_comment:return(comment(tree,n,scope,depth_in,comments_in));
+    case Tree::kind_mock:return(0);
+    case Tree::kind_node:return(tag(tree,n,scope,depth_in,comments_in));
+    default:break;
+  }
+  tree.log(n,"error")<<"Internal error ("<<__FILE__<<":"<<__LINE__<<")!"<<std::endl;
+  return(__LINE__);
+}
+template<class R> int Renderer<R>::include(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  std::string begin;
+  std::string end;
+  tokens_t tokens_local;
+  Files::file_id_t id(tree.link(n));
+  const Tree * file(Files::id2Tree(id));
+  bindTokens(tree,n,*scope.tokens,tokens_local);
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  if (R::debug){
+    marks(comments_in,begin,end);
+    sink<<space<<begin<<"Directive 'include' (start): "<<tokens_local<<end<<std::endl;
+  }
+  if (!file){
+    tree.log(n,"error")<<"Internal error ("<<__FILE__<<":"<<__LINE__<<")!"<<std::endl;
+    return(__LINE__);
+  }
+  if (!linked.count({&tree,n})){//Plik dołączony wcześniej (także w pętli) nie jest powtarzany.
+    if (R::debug) sink<<space<<begin<<"Directive 'include' (stop,0): "<<tokens_local<<end<<std::endl;
+    return(0);
+  }
+  {
+    frame_t & f(push(close_include,tree,n,scope,depth_in,comments_in));
+    f.tokens=tokens_local;
+    f.list=file;
+    f.next=file->first(0);
+    f.scope.tokens=&f.tokens;
+    f.scope.tree=&tree;
+    f.scope.owner=n;
+    f.scope.outer=&scope;
+    if (R::measure) f.scope.id=scopeId(f.scope);
+  }
+  if (R::profile) Profile::push(Profile::kind_include,id);
+  if (!R::measure) {
+    if (Trace::on()) Trace::begin("render","include "+ict::os::getRelativePath(Files::id2Path(id)));
+    ICT_PROBE(dorothy,include_start,tokens_local.get(0).c_str(),id);
+    Stats::include();
+  }
+  return(enter(*file,0,depth_in));
+}
+template<class R> int Renderer<R>::namesp(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  std::string begin;
+  std::string end;
+  const Tree::index_t names(tree.value(n,0));
+  frame_t & f(push(close_namespace,tree,n,scope,depth_in,comments_in));
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  if (!tree.flag(n,Tree::flag_root)) f.namesp=*scope.namesp;
+  for (Tree::index_t i=0;i<names;i++) f.namesp.push_back(tree.string(n,1+i));
+  f.scope.namesp=&f.namesp;
+  if (R::measure) f.scope.id=scopeId(f.scope);
+  if (R::debug){
+    marks(comments_in,begin,end);
+    sink<<space<<begin<<"Directive 'namespace' (start): "<<f.namesp<<end<<std::endl;
+  }
+  return(enter(tree,n,depth_in));
+}
+template<class R> int Renderer<R>::define(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  std::string begin;
+  std::string end;
+  std::size_t c=tree.childrenCount(n);
+  const Tree::index_t names(tree.value(n,0));
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  if (R::debug){
+    marks(comments_in,begin,end);
+    sink<<space<<begin<<"Directive 'define' (start): "<<(*scope.tokens)<<end<<std::endl;
+  }
+  for (Tree::index_t i=0;i<names;i++){
+    std::string fullName(Names::fullName(*scope.namesp,tree.string(n,1+i)));
+    if (Names::name2Node(fullName)!=Tree::none){
+      if ((Names::name2id(fullName)!=tree.getFileId())||(Names::name2no(fullName)!=tree.lineNo(n))){
+        tree.log(n,"error")<<"Name "<<fullName<<" registred twice! First definition: "<<ict::os::getRelativePath(Files::id2Path(Names::name2id(fullName)))<<":"<<Names::name2no(fullName)<<std::endl;
+        return(__LINE__);
+      }
+    } else {
+      Names::add(fullName,n,tree.getFileId(),tree.lineNo(n));
+      if (R::debug) sink<<space<<" "<<begin<<"Directive 'define' has registred new name: "<<fullName<<end<<std::endl;
+    }
+  }
+  if (R::debug){
+    sink<<space<<begin<<"Directive 'define' (stop,"<<c<<"): "<<(*scope.tokens)<<end<<std::endl;
+  }
+  return(0);
+}
+template<class R> int Renderer<R>::clone(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  std::string begin;
+  std::string end;
+  tokens_t tokens_local;
+  bindTokens(tree,n,*scope.tokens,tokens_local);
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  if (R::debug) marks(comments_in,begin,end);
+  if (tree.flag(n,Tree::flag_numeric)){
+    //Dzieci dyrektywy 'include' lub 'clone' są serializowane w jej kontekście.
+    std::size_t no=tree.value(n,1);
+    if (R::debug){
+      sink<<space<<begin<<"Directive 'clone' (start): "<<(*scope.tokens)<<end<<std::endl;
+    }
+    if ((scope.owner!=Tree::none)&&scope.outer){
+      const Tree & owner(*scope.tree);
+      std::string key;
+      if (R::measure){//Kontekst (z dyrektywą 'owner' i jej kontekstem) wyznacza rozwinięcie - rozmiar jest liczony raz.
+        std::map<std::string,std::uint64_t>::const_iterator it;
+        key=memoKey(scope.id,&tree,n,depth_in,comments_in);
+        it=memo.find(key);
+        if (it!=memo.cend()){
+          sink.add(it->second);
+          return(0);
+        }
+      }
+      frame_t & f(push(close_numeric,tree,n,*scope.outer,depth_in,comments_in));
+      f.list=&owner;
+      f.next=no?owner.child(scope.owner,no-1):owner.first(scope.owner);
+      f.single=(no!=0);
+      f.childDepth=depth_in;
+      if (R::measure) {
+        f.memo=std::move(key);
+        f.start=measured();
+      } else {
+        if (Trace::on()) Trace::begin("render","clone "+std::to_string(no));
+        ICT_PROBE(dorothy,clone_start,"",tree.getFileId(),tree.lineNo(n));
+        Stats::clone();
+      }
+    } else if (R::debug){
+      sink<<space<<begin<<"Directive 'clone' (stop,"<<tree.childrenCount(n)<<"): "<<(*scope.tokens)<<end<<std::endl;
+    }
+  } else {
+    const Tree * defined=nullptr;
+    Tree::node_t d(Tree::none);
+    namespace_t namesp(*scope.namesp);
+    std::string fullName;
+    do {
+      fullName=Names::fullName(namesp,tokens_local.get(0));
+      d=Names::name2Node(fullName);
+      if (d==Tree::none){
+        if (namesp.size()) {
+          namesp.pop_back();
+        } else {
+          break;
+        }
+      } else {
+        defined=Names::name2Tree(fullName);
+      }
+    } while(d==Tree::none);
+    if (R::debug){
+      sink<<space<<begin<<"Directive 'clone' (start): "<<tokens_local<<end<<std::endl;
+    }
+    if (defined){
+      std::string key;
+      std::uint64_t id(0);
+      if (R::measure){//Rozwinięcie zależy od bloku, kontekstu i głębokości - rozmiar jest liczony raz.
+        //Dzieci dyrektywy są widoczne tylko dla 'clone <numer>' - bez dzieci (i bez komunikatów -vvvv) dyrektywa i jej kontekst nie zmieniają wyjścia.
+        const bool owned(R::debug||(tree.first(n)!=Tree::none));
+        std::map<std::string,std::uint64_t>::const_iterator it;
+        id=scopeId(scope_t{scope.namesp,&tokens_local,owned?&tree:nullptr,owned?n:Tree::none,owned?&scope:nullptr,0});
+        key=memoKey(id,defined,d,depth_in,comments_in);
+        it=memo.find(key);
+        if (it!=memo.cend()){
+          sink.add(it->second);
+          return(0);
+        }
+      }
+      frame_t & f(push(close_clone,tree,n,scope,depth_in,comments_in));
+      f.tokens=tokens_local;
+      f.list=defined;
+      f.next=defined->first(d);
+      f.scope.tokens=&f.tokens;
+      f.scope.tree=&tree;
+      f.scope.owner=n;
+      f.scope.outer=&scope;
+      f.scope.id=id;
+      if (R::profile) Profile::push(Profile::kind_define,fullName);
+      if (R::measure) {
+        f.memo=std::move(key);
+        f.start=measured();
+      } else {
+        if (Trace::on()) Trace::begin("render","clone "+fullName);
+        ICT_PROBE(dorothy,clone_start,fullName.c_str(),tree.getFileId(),tree.lineNo(n));
+        Stats::clone();
+      }
+      return(enter(*defined,d,depth_in));
+    } else {
+      tree.log(n,"error")<<"Name "<<Names::fullName(*scope.namesp,tokens_local.get(0))<<" not found!"<<std::endl;
+      return(__LINE__);
+    }
+  }
+  return(0);
+}
+template<class R> int Renderer<R>::text(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  sink<<space<<TokenText{tree.string(n,0),*scope.tokens,true}<<std::endl;
+  if (tree.first(n)!=Tree::none) push(close_none,tree,n,scope,depth_in,comments_in);
+  return(enter(tree,n,depth_in));
+}
+template<class R> int Renderer<R>::html(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  sink<<space<<TokenText{tree.string(n,0),*scope.tokens,false}<<std::endl;
+  if (tree.first(n)!=Tree::none) push(close_none,tree,n,scope,depth_in,comments_in);
+  return(enter(tree,n,depth_in));
+}
+template<class R> int Renderer<R>::comment(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  std::string begin;
+  std::string end;
+  if (!R::comments) return(0);
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  marks(comments_in,begin,end);
+  sink<<space<<begin<<TokenText{tree.string(n,0),*scope.tokens,false};
+  if (tree.first(n)!=Tree::none){
+    sink<<std::endl;
+    push(close_comment,tree,n,scope,depth_in,comments_in).childComments=comments_in+1;
+    return(enter(tree,n,depth_in));
+  }
+  sink<<end<<std::endl;
+  return(0);
+}
+template<class R> int Renderer<R>::tag(const Tree & tree,Tree::node_t n,const scope_t & scope,depth_t depth_in,depth_t comments_in){
+  bool c=(tree.first(n)!=Tree::none);
+  const tokens_t & tokens_in(*scope.tokens);
+  const std::string & tag(tree.string(n,2));
+  const std::string & textLine(tree.string(n,3));
+  const Indent space{R::indent?std::size_t(depth_in?(depth_in-1):0):0};
+  if (textLine.size()||c||tree.flag(n,Tree::flag_no_short)){
+    sink<<space<<"<"<<TokenText{tag,tokens_in,true}<<getAttr(tree,n,*scope.namesp,tokens_in)<<">"<<TokenText{textLine,tokens_in,true};
+    if (c){
+      sink<<std::endl;
+      push(close_tag,tree,n,scope,depth_in,comments_in);
+      return(enter(tree,n,depth_in));
+    }
+    if (enter(tree,n,depth_in)) return(__LINE__);
+    sink<<"</"<<TokenText{tag,tokens_in,true}<<">"<<std::endl;
   } else {
-    output<<space<<"<"<<encodeHtml(replaceTokens(tag,tokens_in))<<getAttr(namesp_in,tokens_in)<<"/>"<<std::endl;
+    sink<<space<<"<"<<TokenText{tag,tokens_in,true}<<getAttr(tree,n,*scope.namesp,tokens_in)<<"/>"<<std::endl;
   }
   return(0);
 }
+template<class R> void Renderer<R>::link(Files::file_id_t id){
+  //Plik dołącza dyrektywa 'include', która wystąpiła pierwsza w kolejności parsowania (węzły drzewa są w tej kolejności).
+  std::vector<std::pair<const Tree *,Tree::node_t>> stack;
+  if (!linkedFiles.insert(id).second) return;
+  if (Files::id2Tree(id)) stack.push_back({Files::id2Tree(id),0});
+  while (stack.size()){
+    const Tree * tree(stack.back().first);
+    Tree::node_t n(stack.back().second);
+    while ((n<tree->size())&&(tree->kind(n)!=Tree::kind_include)) n++;
+    if (n>=tree->size()){
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second=n+1;
+    id=tree->link(n);
+    if (!linkedFiles.insert(id).second) continue;
+    linked.insert({tree,n});
+    if (Files::id2Tree(id)) stack.push_back({Files::id2Tree(id),0});
+  }
+}
+template<class R> int Renderer<R>::file(Files::file_id_t id){
+  int out;
+  const static namespace_t namesp;
+  const Tree * tree(Files::id2Tree(id));
+  scope_t scope={&namesp,&options.getTokens(),nullptr,Tree::none,nullptr,0};
+  if (R::measure) scope.id=scopeId(scope);
+  if (!tree){
+    std::cerr<<"ERROR: Internal error ("<<__FILE__<<","<<__LINE__<<")!!!"<<std::endl;
+    return(__LINE__);
+  }
+  const std::size_t depth(Profile::depth());
+  const std::size_t spans(Trace::depth());
+  push(close_none,*tree,0,scope,0,0);
+  if (R::profile) Profile::push(Profile::kind_file,id);
+  out=enter(*tree,0,0);
+  if (out) {
+    unwind();
+    if (R::profile) Profile::truncate(depth);
+    Trace::truncate(spans);
+    return(out);
+  }
+  out=run();
+  if (R::profile) Profile::truncate(depth);
+  Trace::truncate(spans);
+  return(out);
+}
 //===========================================
 depth_t Interface::counter=0;
+std::uint64_t Interface::maxOutput=0;
 Interface::Interface(bool strip_in,depth_t maxDepth_in,depth_t verbose_in,const tokens_t & tokens_in,const std::string & defaultTag_in):
-  c(counter),options(strip_in,maxDepth_in,verbose_in,tokens_in,defaultTag_in){
+  c(counter),options(strip_in,maxDepth_in,verbose_in,tokens_in,defaultTag_in),estimated(false),estimatedSize(0){
     counter++;
+    if (!c) {
+      Stats::reset();
+      Profile::reset();
+    }
   }
 Interface::~Interface(){
-  Files::clear();
+  Files::release();
   Names::clear();
   for (Line * f:files) if (f) delete(f);
+  for (Line * f:parsed) if (f) delete(f);
   counter--;
 }
+void Interface::setCache(bool cache_in){
+  Files::setCache(cache_in);
+}
+void Interface::setCacheDir(const std::string & dir_in,std::uint64_t maxSize_in){
+  Cache::setDir(dir_in,maxSize_in);
+}
+void Interface::setStats(bool stats_in){
+  Stats::setEnabled(stats_in);
+}
+void Interface::getStats(stats_t & stats){
+  Stats::get(stats);
+}
+void Interface::setProfile(bool profile_in){
+  Profile::setEnabled(profile_in);
+}
+void Interface::profile(std::ostream & output,std::size_t top){
+  Profile::report(output,top);
+}
+void Interface::profileStacks(std::ostream & output){
+  Profile::collapsed(output);
+}
+void Interface::setMaxOutput(std::uint64_t maxOutput_in){
+  maxOutput=maxOutput_in;
+}
+void Interface::setTrace(bool trace_in){
+  Trace::setEnabled(trace_in);
+}
+void Interface::traceBegin(const std::string & category,const std::string & name){
+  if (!Trace::on()) return;
+  static std::set<std::string> categories;//Kategoria żyje do końca procesu.
+  Trace::begin(categories.insert(category).first->c_str(),name);
+}
+void Interface::traceEnd(){
+  if (Trace::on()) Trace::end();
+}
+void Interface::trace(std::ostream & output,long pid,const std::string & process){
+  Trace::write(output,pid,process);
+}
 void Interface::addInput(const std::string & input){
   if (c) return;
   files.emplace_back(new LineFile(input));
 }
+//! Parsuje ponownie (w miejscu) nieaktualne pliki osiągalne z danego pliku - pozostałe pliki zostają w pamięci podręcznej.
+static int reparse(const Options & options,line_list_t & parsed,Files::file_id_t id){
+  for (;;){
+    Files::file_list_t ids;
+    Files::file_id_t stale(-1);
+    Files::includesAll(id,ids);
+    for (Files::file_id_t i : ids) if (Files::isStale(i)) {
+      stale=i;
+      break;
+    }
+    if (stale==Files::file_id_t(-1)) return(0);
+    {
+      int out;
+      LineFile * f(new LineFile(Files::id2Path(stale)));
+      parsed.push_back(f);
+      out=f->parseLine(options);
+      if (out) return(out);
+    }
+  }
+}
 int Interface::parse(){
   int out;
   if (c) return(__LINE__);
+  Stats::Frame frame(Stats::phase_link);
+  Files::validate();
   for (Line * f:files) if (f) {
     out=f->parseLine(options);
     if (out) return(out);
+    out=reparse(options,parsed,f->getLinkedId());
+    if (out) return(out);
   }
   return(0);
 }
+int Interface::scan(){
+  options.setScan(true);
+  return(parse());
+}
 int Interface::dependences(std::ostream & output){
   int out;
   if (c) return(__LINE__);
@@ -1559,15 +3501,152 @@ int Interface::dependencesAll(std::ostream & output){
   if (c) return(__LINE__);
   return(Files::dependences(options,output));
 }
-int Interface::serialize(std::ostream & output){
-  int out;
+int Interface::dependencesList(std::vector<std::string> & list){
+  Files::file_list_t ids;
   if (c) return(__LINE__);
+  for (Line * f:files) if (f) Files::includesAll(f->getLinkedId(),ids);
+  {
+    Files::file_set_t unique;
+    for (Files::file_id_t id : ids) if (!unique.count(id)) {
+      unique.insert(id);
+      list.push_back(Files::id2Path(id));
+    }
+  }
+  return(0);
+}
+template<class R> int Interface::serializeAll(std::ostream & output){
+  int out;
+  Renderer<R> renderer(options,output);
+  for (Line * f:files) if (f) renderer.link(f->getLinkedId());
   for (Line * f:files) if (f) {
-    out=f->serializeLine(options,output);
+    out=renderer.file(f->getLinkedId());
     if (out) return(out);
   }
   return(0);
 }
+int Interface::precompile(std::ostream & output){
+  if (c) return(__LINE__);
+  if (files.size()!=1) {
+    std::cerr<<"ERROR: Precompiled file needs exactly one input!"<<std::endl;
+    return(__LINE__);
+  }
+  Stats::Frame frame(Stats::phase_link);
+  return(Image::save(files.front()->getLinkedId(),output));
+}
+template<class R> int Interface::estimateAll(std::uint64_t & size){
+  int out=0;
+  std::ostream none(nullptr);//Estymacja nie pisze do strumienia.
+  Renderer<R> renderer(options,none,maxOutput);
+  const Names::name_map_t names(Names::get());
+  for (Line * f:files) if (f) renderer.link(f->getLinkedId());
+  for (Line * f:files) if (f) {
+    out=renderer.file(f->getLinkedId());
+    if (out) break;
+  }
+  size=renderer.measured();
+  Names::set(names);
+  return(out);
+}
+int Interface::estimate(std::uint64_t & size){
+  int out;
+  if (c) return(__LINE__);
+  if (estimated) {//Estymacja przed otwarciem wyjścia jest używana przez serialize().
+    size=estimatedSize;
+    return(0);
+  }
+  {
+    Trace::Span span("render","estimate");
+    Stats::Frame frame(Stats::phase_estimate);
+    if (options.getStrip()) {
+      out=estimateAll<RenderStripMeasure>(size);
+    } else if (options.getVerbose()>LOG_DEBUG) {
+      out=estimateAll<RenderDebugMeasure>(size);
+    } else {
+      out=estimateAll<RenderPrettyMeasure>(size);
+    }
+  }
+  if (maxOutput&&(size>maxOutput)){
+    std::cerr<<"ERROR: Estimated output size exceeds limit ("<<maxOutput<<" bytes) - check clone fan-out or change --max-output param!"<<std::endl;
+    return(__LINE__);
+  }
+  if (out) return(out);
+  Stats::estimated(size);
+  estimated=true;
+  estimatedSize=size;
+  return(0);
+}
+int Interface::serializeMode(std::ostream & output){
+  if (Profile::on()){
+    if (options.getStrip()) return(serializeAll<RenderStripProfile>(output));
+    if (options.getVerbose()>LOG_DEBUG) return(serializeAll<RenderDebugProfile>(output));
+    return(serializeAll<RenderPrettyProfile>(output));
+  }
+  if (options.getStrip()) return(serializeAll<RenderStrip>(output));
+  if (options.getVerbose()>LOG_DEBUG) return(serializeAll<RenderDebug>(output));
+  return(serializeAll<RenderPretty>(output));
+}
+int Interface::render(std::ostream & output){
+  if (Stats::on()||Profile::on()){//Wyjście przez bufor liczący bajty.
+    Stats::Frame frame(Stats::phase_render);
+    CountBuf buffer(output.rdbuf());
+    std::ostream counted(&buffer);
+    const int out(serializeMode(counted));
+    Stats::written(buffer.size());
+    if (!counted.good()) output.setstate(std::ios_base::badbit);
+    return(out);
+  }
+  return(serializeMode(output));
+}
+int Interface::serialize(std::ostream & output){
+  if (c) return(__LINE__);
+  Trace::Span span("render","render");
+  if (maxOutput){//Estymacja przed serializacją tylko dla limitu - statystyki nie dokładają serializacji, którą mierzą.
+    std::uint64_t size;
+    const int out(estimate(size));
+    if (out) return(out);
+  }
+  return(render(output));
+}
+int Interface::serialize(std::string & output){
+  if (c) return(__LINE__);
+  Trace::Span span("render","render");
+  output.clear();
+  {//Pamięć napisu jest rezerwowana raz - estymacja liczy tylko długości i różne rozwinięcia 'clone'.
+    std::uint64_t size;
+    const int out(estimate(size));
+    if (out) return(out);
+    output.reserve(size);
+  }
+  {
+    StringBuf buffer(output);
+    std::ostream stream(&buffer);
+    return(render(stream));
+  }
+}
+//===========================================
+namespace kernels {
+std::string fullName(const namespace_t & namesp,const std::string & name){
+  return(Names::fullName(namesp,name));
+}
+bool getLine(std::istream & input,unsigned int & lineCount,std::string & line){
+  return(Files::getLine(input,lineCount,line));
+}
+}
 //===========================================
 }}
+//===========================================
+std::ostream & operator << (std::ostream & s,const ict::dorothy::tokens_t & v){
+  bool first=true;
+  s<<"{";
+  for (ict::dorothy::tokens_t::index_t i=0;i<v.size();i++) if (v.has(i)){
+    if (first){
+      first=false;
+    } else {
+      s<<",";
+    }
+    s<<i<<":"<<v.get(i);
+  }
+  s<<"}";
+  return(s);
+}
 //===========================================
\ No newline at end of file
@@ -41,25 +41,56 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <map>
 #include <memory>
+#include <cstdint>
 //============================================
 namespace ict { namespace dorothy {
 //===========================================
   class Line;
   typedef unsigned int depth_t;
-  typedef std::map<unsigned int,std::string> tokens_t;
   typedef std::vector<Line*> line_list_t;
 
+  //! Ramka tokenów ($1, $2, ...) - ciągła tablica indeksowana numerem tokena.
+  //! Kopie ramki współdzielą tablicę do pierwszej modyfikacji (copy-on-write).
+  class Tokens {
+  public:
+    typedef std::size_t index_t;
+    struct slot_t {std::string value;bool set;};
+    typedef std::vector<slot_t> slots_t;
+    //! Maksymalna liczba pozycji w ramce (ogranicza rozmiar tablicy dla rzadkich numerów tokenów).
+    static const index_t maxSize=0x10000;
+  private:
+    std::shared_ptr<slots_t> slots;
+    static const std::string emptyValue;
+    slots_t & write();
+  public:
+    Tokens(){}
+    explicit Tokens(index_t capacity_in);
+    index_t size() const {return(slots?slots->size():0);}
+    bool empty() const {return(!size());}
+    bool has(index_t i) const {return(slots&&(i<slots->size())&&(*slots)[i].set);}
+    const std::string & get(index_t i) const {return((slots&&(i<slots->size()))?(*slots)[i].value:emptyValue);}
+    bool set(index_t i,const std::string & value_in);
+    bool set(index_t i,std::string && value_in);
+    bool push(const std::string & value_in){return(set(size(),value_in));}
+    bool push(std::string && value_in){return(set(size(),std::move(value_in)));}
+  };
+  typedef Tokens tokens_t;
+
   class Options{
   private:
     bool strip;
+    bool scan;
     depth_t maxDepth;
     depth_t verbose;
     std::string defaultTag;
     tokens_t tokens;
   public:
     Options(bool strip_in,depth_t maxDepth_in,depth_t verbose_in,const tokens_t & tokens_in,const std::string & defaultTag_in="div"):
-      strip(strip_in),maxDepth(maxDepth_in),verbose(verbose_in),tokens(tokens_in),defaultTag(defaultTag_in){}
+      strip(strip_in),scan(false),maxDepth(maxDepth_in),verbose(verbose_in),tokens(tokens_in),defaultTag(defaultTag_in){}
     bool getStrip() const {return(strip);}
+    //! Tylko lista zależności - czytane są wyłącznie dyrektywy 'include' (bez drzewa).
+    bool getScan() const {return(scan);}
+    void setScan(bool scan_in){scan=scan_in;}
     depth_t getMaxDepth() const {return(maxDepth);}
     bool testMaxDepth(depth_t d) const {return(d<maxDepth);}
     depth_t getVerbose() const {return(verbose);}
@@ -68,22 +99,107 @@ namespace ict { namespace dorothy {
     const tokens_t & getTokens() const {return(tokens);}
   };
 
+  //! Czas fazy w ns - zegar ścienny i czas procesora.
+  struct time_stats_t {std::uint64_t wall=0;std::uint64_t cpu=0;};
+  //! Statystyki pliku (czasy bez plików dołączanych).
+  struct file_stats_t {
+    std::string path;
+    std::uint64_t bytes=0;
+    std::uint64_t lines=0;
+    time_stats_t read;
+    time_stats_t lex;
+    time_stats_t parse;
+    time_stats_t link;
+  };
+  //! Statystyki jednego obiektu Interface (--stats).
+  //! Zegar procesora jest czytany tylko na granicach plików i faz - czas procesora faz wewnątrz pliku (read, lex, parse) jest dzielony według czasu ściennego.
+  struct stats_t {
+    std::vector<file_stats_t> files;
+    time_stats_t read;
+    time_stats_t lex;
+    time_stats_t parse;
+    time_stats_t link;
+    time_stats_t render;
+    //! Estymacja rozmiaru wyjścia przed serializacją (limit --max-output, serializacja do napisu) - zero, gdy estymacja nie była liczona.
+    time_stats_t estimate;
+    //! Liczba utworzonych obiektów linii (nazwa klasy).
+    std::map<std::string,std::uint64_t> lines;
+    //! Rozwinięcia dyrektyw 'include' i 'clone' przy serializacji.
+    std::uint64_t includes=0;
+    std::uint64_t clones=0;
+    std::uint64_t bytesRead=0;
+    std::uint64_t bytesWritten=0;
+    //! Rozmiar wyjścia z estymacji przed serializacją (zero, gdy estymacja nie była liczona).
+    std::uint64_t bytesEstimated=0;
+  };
+
   class Interface{
   private:
     static depth_t counter;
+    static std::uint64_t maxOutput;
     depth_t c;
     Options options;
+    //! Wynik estimate() - kolejne wywołania (np. serialize() po sprawdzeniu limitu przed otwarciem wyjścia) nie liczą go ponownie.
+    bool estimated;
+    std::uint64_t estimatedSize;
     line_list_t files;
+    //! Pliki parsowane ponownie (zmienione pliki z pamięci podręcznej).
+    line_list_t parsed;
+    template<class R> int serializeAll(std::ostream & output);
+    template<class R> int estimateAll(std::uint64_t & size);
+    //! Serializacja z polityką wybraną przez opcje (strip, -vvvv).
+    int serializeMode(std::ostream & output);
+    //! Serializacja bez estymacji (liczenie bajtów dla statystyk i profilu).
+    int render(std::ostream & output);
   public:
     Interface(bool strip_in,depth_t maxDepth_in,depth_t verbose_in,const tokens_t & tokens_in,const std::string & defaultTag_in="div");
     ~Interface();
+    //! Sparsowane pliki są zachowywane między kolejnymi obiektami (tryby --worker i --serve), zmiana pliku (mtime, size) unieważnia wpis.
+    //! Wyłączenie odkłada zachowane pliki na bok, ponowne włączenie je przywraca.
+    static void setCache(bool cache_in);
+    //! Pamięć podręczna drzew na dysku (pusta ścieżka - wyłączona), wspólna dla procesów; 'maxSize' - limit rozmiaru katalogu w bajtach (0 - bez limitu).
+    static void setCacheDir(const std::string & dir_in,std::uint64_t maxSize_in);
+    //! Włącza zbieranie statystyk (--stats) dla kolejnego obiektu - wyłączone nie kosztują nic poza sprawdzeniem flagi.
+    static void setStats(bool stats_in);
     void addInput(const std::string & input);
     int parse();
+    //! Jak parse(), ale czyta tylko dyrektywy 'include' - wystarcza dla dependences() i dependencesAll(), nie dla serialize().
+    int scan();
     int dependences(std::ostream & output);
     int dependencesAll(std::ostream & output);
+    //! Lista wszystkich plików (pełne ścieżki), od których zależy wynik - pliki wejściowe i pliki dołączane.
+    int dependencesList(std::vector<std::string> & list);
+    //! Z limitem rozmiaru serializację poprzedza estymacja rozmiaru wyjścia (estimate()), statystyki jej nie włączają.
     int serialize(std::ostream & output);
+    //! Serializacja do napisu - pamięć napisu jest rezerwowana raz z estymacji rozmiaru (estimate()).
+    int serialize(std::string & output);
+    //! Dokładny rozmiar wyjścia serialize() (dla UTF-8) bez zapisu i bez tworzenia napisów - linie dodają stałe bajty, długości tokenów i wcięcia,
+    //! a rozwinięcia 'clone' o tym samym kluczu (blok, kontekst, głębokość) są liczone raz, więc koszt zależy od liczby różnych rozwinięć,
+    //! nie od rozmiaru wyjścia. Błąd, gdy rozmiar przekracza setMaxOutput().
+    int estimate(std::uint64_t & size);
+    //! Limit rozmiaru wyjścia w bajtach (0 - bez limitu) - serialize() kończy się błędem przed zapisem (np. eksplozja rozwinięć 'clone').
+    static void setMaxOutput(std::uint64_t maxOutput_in);
+    //! Zapisuje plik prekompilowany (.dorothyc) dla jedynego pliku wejściowego - plik wejściowy dla kolejnych obiektów (addInput()) zamiast źródeł.
+    int precompile(std::ostream & output);
+    //! Statystyki zebrane od utworzenia ostatniego obiektu (gdy włączone przez setStats()).
+    static void getStats(stats_t & stats);
+    //! Włącza profil serializacji (--profile) dla kolejnych obiektów - wyłączony nie kosztuje nic (osobna instancja serializacji).
+    static void setProfile(bool profile_in);
+    //! Raport profilu od utworzenia ostatniego obiektu - 'top' najdroższych bloków 'define', plików 'include', plików i linii źródła.
+    static void profile(std::ostream & output,std::size_t top);
+    //! Stosy profilu w formacie collapsed (linia: ramki rozdzielone ';' i czas w ns) - wejście dla flamegraph.pl.
+    static void profileStacks(std::ostream & output);
+    //! Włącza ślad (--trace) - odcinki parsowania plików, dyrektyw 'include' (parsowanie i serializacja), rozwinięć 'clone' i serializacji.
+    static void setTrace(bool trace_in);
+    //! Odcinek śladu otwarty poza modułem (np. zapis wyjścia) - zamykany przez traceEnd() w odwrotnej kolejności.
+    static void traceBegin(const std::string & category,const std::string & name);
+    static void traceEnd();
+    //! Zapisuje zdarzenia śladu jako obiekty JSON rozdzielone przecinkami (bez tablicy 'traceEvents') z nazwą procesu 'process' i usuwa je.
+    static void trace(std::ostream & output,long pid,const std::string & process);
   };
 //===========================================
 }}
 //============================================
+std::ostream & operator << (std::ostream & s,const ict::dorothy::tokens_t & v);
+//============================================
 #endif
\ No newline at end of file
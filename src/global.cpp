@@ -312,18 +312,25 @@ int main(int argc, char **argv,main_fun_t next){
   }
   processId=std::to_string(getpid());
   processTime=std::to_string(time(NULL));
-  if (environ){
-    for (int k=0;environ[k];k++){
-      std::string e(environ[k]);
-      std::size_t at(e.find('='));
-      if (at==std::string::npos){
-        env[e]="";
-      } else {
-        env[e.substr(0,at)]=e.substr(at+1);
+  return(next?next():-1);
+}
+env_t & getEnv(){
+  static bool loaded=false;
+  if (!loaded){
+    loaded=true;
+    if (environ){
+      for (int k=0;environ[k];k++){
+        std::string e(environ[k]);
+        std::size_t at(e.find('='));
+        if (at==std::string::npos){
+          env[e]="";
+        } else {
+          env[e.substr(0,at)]=e.substr(at+1);
+        }
       }
     }
   }
-  return(next?next():-1);
+  return(env);
 }
 //===========================================
 } }
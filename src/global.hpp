@@ -62,7 +62,7 @@ typedef std::map<std::string,std::string> env_t;
 //===========================================
 //! Przechowuje argumenty podane przy uruchomieniu programu.
 extern arg_t arg;
-//! Przechowuje zmienne środowiskowe podane przy uruchomieniu programu.
+//! Przechowuje zmienne środowiskowe podane przy uruchomieniu programu (wypełniane przez getEnv()).
 extern env_t env;
 //! Identyfikator procesu.
 extern std::string processId;
@@ -200,6 +200,12 @@ void base64Decode(const std::string & input,std::string & output);
 //! @return Kod wyjściowy procesu, który zwróciła podstawowa funkcja procesu.
 //!
 int main(int argc, char **argv,main_fun_t next);
+//! 
+//! @brief Zwraca zmienne środowiskowe procesu (kopiowane przy pierwszym wywołaniu, a nie przy starcie).
+//!
+//! @return Zmienne środowiskowe.
+//!
+env_t & getEnv();
 //===========================================
 } }
 //============================================
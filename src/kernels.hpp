@@ -0,0 +1,64 @@
+//! @file
+//! @brief Dorothy string kernels (internal, for microbenchmarks) - header file.
+//! @author Mariusz Ornowski (mariusz.ornowski@ict-project.pl)
+//! @version 1.0
+//! @date 2016
+//! @copyright ICT-Project Mariusz Ornowski (ict-project.pl)
+/* **************************************************************
+Copyright (c) 2016, ICT-Project Mariusz Ornowski (ict-project.pl)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. Neither the name of the ICT-Project Mariusz Ornowski nor the names
+of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**************************************************************/
+#ifndef _DOROTHY_KERNELS_HEADER
+#define _DOROTHY_KERNELS_HEADER
+//============================================
+#include "dorothy.hpp"
+#include <string>
+#include <vector>
+#include <iostream>
+//============================================
+namespace ict { namespace dorothy {
+//===========================================
+//! Przestrzeń nazw (lista nazw bloków 'namespace' od zewnętrznego).
+typedef std::vector<std::string> namespace_t;
+//! Koduje znaki specjalne HTML.
+std::string encodeHtml(const std::string & input);
+//! Zastępuje tokeny ($1, $2, ...) wartościami.
+std::string replaceTokens(const std::string & input,const tokens_t & tokens_in);
+//! Funkcje wewnętrzne modułu udostępnione dla pomiarów (bench_kernels) - nie są częścią interfejsu.
+namespace kernels {
+//===========================================
+//! Pełna nazwa z przestrzenią nazw (Names::fullName).
+std::string fullName(const namespace_t & namesp,const std::string & name);
+//! Czyta linię źródłową z kontynuacjami '\' (Files::getLine).
+bool getLine(std::istream & input,unsigned int & lineCount,std::string & line);
+//===========================================
+}
+//===========================================
+}}
+//===========================================
+#endif
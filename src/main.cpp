@@ -38,16 +38,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "main.hpp"
 #include "os.hpp"
 #include "dorothy.hpp"
+#include "server.hpp"
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <string>
 #include <vector>
-#include <regex>
+#include <set>
+#include <map>
+#include <deque>
+#include <cstdio>
+#include <chrono>
+#include <unistd.h>
+#include <sys/wait.h>
 //============================================
 //target dorothy
 //ldflags 
 //cppflags -std=c++11 
-//include ./src/global.cpp ./src/os.cpp ./src/dorothy.cpp
+//include ./src/global.cpp ./src/os.cpp ./src/dorothy.cpp ./src/server.cpp
 //============================================
 namespace ict { namespace main {
 //===========================================
@@ -57,7 +66,15 @@ enum mode_t {
   all_dependences=10,
   direct_dependences=11,
   compile_strip=100,
-  compile_no_strip=101
+  compile_no_strip=101,
+  precompile=102,
+  worker=200,
+  serve=201
+};
+enum stats_mode_t {
+  stats_none=0,
+  stats_text=1,
+  stats_json=2
 };
 struct options_t {
   mode_t mode=compile_no_strip;
@@ -66,6 +83,38 @@ struct options_t {
   ict::dorothy::tokens_t tokens;
   std::vector<std::string> input;
   std::string output;
+  //Ścieżka gniazda i liczba procesów demona (--serve).
+  std::string socket;
+  unsigned int workers=0;
+  //Pamięć podręczna sparsowanych plików (--worker, --serve, --watch).
+  bool cache=false;
+  //Ponowna kompilacja po zmianie plików (--watch).
+  bool watch=false;
+  //Kompilacja par (wejście, wyjście) w osobnych procesach (--batch) i ich liczba bez jobservera make (--jobs).
+  bool batch=false;
+  unsigned int jobs=0;
+  //Plik zależności dla make zapisywany przy kompilacji (-MD, -MF <plik>), depfileNext - ścieżka w kolejnym argumencie.
+  bool depfile=false;
+  bool depfileNext=false;
+  std::string depfilePath;
+  //Zależności są zbierane tylko z linii 'include' bez parsowania pozostałych linii (--dep-scan).
+  bool depScan=false;
+  //Wyjście jest zapisywane tylko po zmianie zawartości (--if-changed).
+  bool ifChanged=false;
+  //Katalog pamięci podręcznej drzew na dysku i jego limit w MB (--cache-dir, --cache-size).
+  std::string cacheDir;
+  unsigned int cacheSize=256;
+  //Limit rozmiaru wyjścia w MB sprawdzany przed serializacją (--max-output, 0 - bez limitu).
+  unsigned int maxOutput=0;
+  //Statystyki kompilacji na standardowym wyjściu błędów (--stats, --stats=json).
+  stats_mode_t stats=stats_none;
+  //Profil serializacji na standardowym wyjściu błędów (--profile), stosy w formacie collapsed (--profile=<plik>) i długość list (--profile-top).
+  bool profile=false;
+  std::string profilePath;
+  std::size_t profileTop=20;
+  //Ślad dla przeglądarki śladów (--trace=<plik>), tracePart - zadanie --batch zapisuje zdarzenia do pliku częściowego (<plik>.<pid>).
+  std::string trace;
+  bool tracePart=false;
   //App out value.
   int out;
 };
@@ -74,28 +123,48 @@ static int internal_error(int line){
   std::cerr<<"ERROR: Internal error ("<<__FILE__<<","<<line<<")!!!"<<std::endl;
   return(10000+line);
 }
+static int token_error(unsigned int token){
+  std::cerr<<"ERROR(-7): Token number too big: "<<token<<" (max "<<(ict::dorothy::tokens_t::maxSize-1)<<")!"<<std::endl;
+  return(-7);
+}
+//! Sprawdza, czy napis jest liczbą (same cyfry).
+static bool is_number(const std::string & in){
+  if (!in.size()) return(false);
+  for (const char c : in) if ((c<'0')||('9'<c)) return(false);
+  return(true);
+}
+//! Sprawdza, czy napis jest nazwą opcji (litery, cyfry oraz '_' i '-' w opcjach długich).
+static bool is_option(const std::string & in,bool long_in){
+  if (!in.size()) return(false);
+  for (const char c : in) switch (c){
+    case '_':case '-':if (long_in) break;return(false);
+    default:
+      if ((('a'<=c)&&(c<='z'))||(('A'<=c)&&(c<='Z'))||(('0'<=c)&&(c<='9'))) break;
+      return(false);
+  }
+  return(true);
+}
 static int parse_options_add(options_t & options,const std::string & in){
   options.input.push_back(in);
   return(0);
 }
 static int parse_options_short(options_t & options,const std::string & in,unsigned int & token){
-  static std::regex r_D("^D$");
-  static std::regex r_d("^d$");
-  static std::regex r_s("^s$");
-  static std::regex r_v("^v$");
-  static std::regex r_h("^h$");
-  static std::regex r_0("^[0-9]+$");
-  if (std::regex_match(in,r_D)){
+  if (in=="MD"){
+    options.depfile=true;
+  } else if (in=="MF"){
+    options.depfile=true;
+    options.depfileNext=true;
+  } else if (in=="D"){
     options.mode=all_dependences;
-  } else if (std::regex_match(in,r_d)){
+  } else if (in=="d"){
     options.mode=direct_dependences;
-  } else if (std::regex_match(in,r_s)){
+  } else if (in=="s"){
     options.mode=compile_strip;
-  } else if (std::regex_match(in,r_v)){
+  } else if (in=="v"){
     options.verbose++;
-  } else if (std::regex_match(in,r_h)){
+  } else if (in=="h"){
     options.mode=print_help;
-  } else if (std::regex_match(in,r_0)){
+  } else if (is_number(in)){
     try {
       token=std::stoul(in);
     } catch (...){
@@ -116,37 +185,94 @@ static int parse_options_short(options_t & options,const std::string & in,unsign
   return(0);
 }
 static int parse_options_long(options_t & options,const std::string & in1,const std::string & in2=""){
-  static std::regex r_D("^dep-all$");
-  static std::regex r_d("^dep$");
-  static std::regex r_s("^strip$");
-  static std::regex r_v("^vebose$");
-  static std::regex r_h("^help$");
-  static std::regex r_ver("^version$");
-  static std::regex r_md("^max-depth");
-  static std::regex r_0("^[0-9]+$");
-  if (std::regex_match(in1,r_D)){
+  if (in1=="dep-all"){
     options.mode=all_dependences;
-  } else if (std::regex_match(in1,r_d)){
+  } else if (in1=="dep"){
     options.mode=direct_dependences;
-  } else if (std::regex_match(in1,r_s)){
+  } else if (in1=="dep-scan"){
+    options.depScan=true;
+  } else if (in1=="strip"){
     options.mode=compile_strip;
-  } else if (std::regex_match(in1,r_v)){
+  } else if (in1=="verbose"){
     options.verbose++;
-  } else if (std::regex_match(in1,r_h)){
+  } else if (in1=="help"){
     options.mode=print_help;
-  } else if (std::regex_match(in1,r_ver)){
+  } else if (in1=="version"){
     options.mode=print_ver;
-  } else if (std::regex_match(in1,r_md)){
+  } else if (in1=="precompile"){
+    options.mode=precompile;
+  } else if (in1=="worker"){
+    options.mode=worker;
+  } else if (in1=="if-changed"){
+    options.ifChanged=true;
+  } else if (in1=="cache-dir"){
+    options.cacheDir=in2;
+  } else if (in1=="cache-size"){
+    try {
+      options.cacheSize=std::stoul(in2);
+    } catch (...){
+      return(internal_error(__LINE__));
+    }
+  } else if (in1=="max-output"){
+    try {
+      options.maxOutput=std::stoul(in2);
+    } catch (...){
+      return(internal_error(__LINE__));
+    }
+  } else if (in1=="stats"){
+    if ((in2=="")||(in2=="text")){
+      options.stats=stats_text;
+    } else if (in2=="json"){
+      options.stats=stats_json;
+    } else {
+      std::cerr<<"ERROR(-2): Unknown stats format: "<<in2<<std::endl;
+      return(-2);
+    }
+  } else if (in1=="profile"){
+    options.profile=true;
+    options.profilePath=in2;
+  } else if (in1=="trace"){
+    if (in2==""){
+      std::cerr<<"ERROR(-2): Trace file is missing: --"<<in1<<std::endl;
+      return(-2);
+    }
+    options.trace=in2;
+  } else if (in1=="profile-top"){
+    try {
+      options.profileTop=std::stoul(in2);
+    } catch (...){
+      return(internal_error(__LINE__));
+    }
+  } else if (in1=="batch"){
+    options.batch=true;
+  } else if (in1=="jobs"){
+    try {
+      options.jobs=std::stoul(in2);
+    } catch (...){
+      return(internal_error(__LINE__));
+    }
+  } else if (in1=="watch"){
+    options.watch=true;
+  } else if (in1=="serve"){
+    options.mode=serve;
+    options.socket=in2;
+  } else if (in1=="workers"){
+    try {
+      options.workers=std::stoul(in2);
+    } catch (...){
+      return(internal_error(__LINE__));
+    }
+  } else if (in1=="max-depth"){
     try {
       ict::dorothy::depth_t depth=std::stoul(in2);
       options.maxDepth=depth;
     } catch (...){
       return(internal_error(__LINE__));
     }
-  } else if (std::regex_match(in1,r_0)){
+  } else if (is_number(in1)){
     try {
       unsigned int token=std::stoul(in1);
-      options.tokens[token]=in2;
+      if (!options.tokens.set(token,in2)) return(token_error(token));
     } catch (...){
       return(internal_error(__LINE__));
     }
@@ -164,29 +290,22 @@ static int parse_options(options_t & options){
     if (first){
       first=false;
     } else if (token){
-      options.tokens[token]=arg;
+      if (!options.tokens.set(token,arg)) return(token_error(token));
       token=0;
+    } else if (options.depfileNext){
+      options.depfilePath=arg;
+      options.depfileNext=false;
     } else {
-      static std::regex r0("^-$");
-      static std::regex r1("^-([a-zA-Z0-9]+)$");
-      static std::regex r2("^--([a-zA-Z0-9_]+)$");
-      static std::regex r3("^--([a-zA-Z0-9_]+)=(.*)$");
-      std::smatch match;
-      if (std::regex_match(arg,match,r0)){
+      const std::size_t at(arg.find('='));
+      if (arg=="-"){
         out=parse_options_add(options,arg);
-      } else if (std::regex_match(arg,match,r1)){
-        if (match.size()<2) return(internal_error(__LINE__));
-        out=parse_options_short(options,match[1],token);
-      } else if (std::regex_match(arg,match,r2)){
-        if (match.size()<2) return(internal_error(__LINE__));
-        out=parse_options_long(options,match[1]);
-      } else if (std::regex_match(arg,match,r3)){
-        if (match.size()<2) return(internal_error(__LINE__));
-        if (match.size()>2){
-          out=parse_options_long(options,match[1],match[2]);
-        } else {
-          out=parse_options_long(options,match[1]);
-        }
+      } else if ((arg.size()>1)&&(arg[0]=='-')&&is_option(arg.substr(1),false)){// -<opcje>
+        out=parse_options_short(options,arg.substr(1),token);
+      } else if ((arg.size()>2)&&(arg.compare(0,2,"--")==0)&&(at==std::string::npos)&&is_option(arg.substr(2),true)){// --<opcja>
+        out=parse_options_long(options,arg.substr(2));
+      } else if ((arg.size()>2)&&(arg.compare(0,2,"--")==0)&&(at!=std::string::npos)&&is_option(arg.substr(2,at-2),true)&&
+        (arg.find_first_of("\r\n",at)==std::string::npos)){// --<opcja>=<wartość> (wartość w jednej linii)
+        out=parse_options_long(options,arg.substr(2,at-2),arg.substr(at+1));
       } else {
         out=parse_options_add(options,arg);
       }
@@ -208,6 +327,19 @@ static int test_options(options_t & options){
     std::cerr<<"ERROR(-4): Output is missing!"<<std::endl;
     return(-4);
   }
+  if (options.depfile&&(!options.depfilePath.size())){
+    std::size_t dot(options.output.rfind('.'));
+    std::size_t slash(options.output.rfind('/'));
+    if (options.output=="-"){
+      std::cerr<<"ERROR(-4): Dependences file is missing (use -MF)!"<<std::endl;
+      return(-4);
+    }
+    if ((dot!=std::string::npos)&&((slash==std::string::npos)||(slash<dot))) {
+      options.depfilePath=options.output.substr(0,dot)+".d";
+    } else {
+      options.depfilePath=options.output+".d";
+    }
+  }
   for (const auto & path : options.input) if (path!="-") if (!ict::os::isFileReadable(path)){
     std::cerr<<"ERROR(-5): Can not read input "<<path<<" !"<<std::endl;
     return(-5);
@@ -221,6 +353,9 @@ static int test_options(options_t & options){
       case direct_dependences: std::cerr<<"Get direct dependences.";break;
       case compile_strip: std::cerr<<"Compile (strip).";break;
       case compile_no_strip: std::cerr<<"Compile (no strip).";break;
+      case precompile: std::cerr<<"Precompile.";break;
+      case worker: std::cerr<<"Worker.";break;
+      case serve: std::cerr<<"Serve.";break;
       default:internal_error(__LINE__);break;
     }
     std::cerr<<std::endl;
@@ -228,12 +363,13 @@ static int test_options(options_t & options){
     for (const auto & str : options.input) std::cerr<<str<<" ";
     std::cerr<<std::endl;
     std::cerr<<"Output: "<<options.output<<std::endl;
+    if (options.depfile) std::cerr<<"Dependences file: "<<options.depfilePath<<std::endl;
     std::cerr<<"Working dir: "<<ict::os::getCurrentDir()<<std::endl;
     std::cerr<<"Verbose: "<<options.verbose<<std::endl;
     std::cerr<<"Tokens: "<<std::endl;
     std::cerr<<" $$ = $"<<std::endl;
-    for (ict::dorothy::tokens_t::const_iterator it=options.tokens.cbegin();it!=options.tokens.cend();++it){
-      std::cerr<<" $"<<it->first<<"$ = "<<it->second<<std::endl;
+    for (ict::dorothy::tokens_t::index_t i=0;i<options.tokens.size();i++) if (options.tokens.has(i)){
+      std::cerr<<" $"<<i<<"$ = "<<options.tokens.get(i)<<std::endl;
     }
   }
   return(0);
@@ -252,15 +388,43 @@ static int print_usage(options_t & options){
     std::cerr<<" "<<ict::global::arg[0]<<" -d input output"<<std::endl;
     std::cerr<<" "<<ict::global::arg[0]<<" options input output"<<std::endl;
     std::cerr<<" "<<ict::global::arg[0]<<" -s options input output"<<std::endl;
-    std::cerr<<"Input: File path or '-' if standard input should be used (UTF8)."<<std::endl;
+    std::cerr<<"Input: File path or '-' if standard input should be used (UTF8), or precompiled file (see --precompile)."<<std::endl;
     std::cerr<<"Output: File path or '-' if standard output should be used (UTF8)."<<std::endl;
     std::cerr<<"Options:"<<std::endl;
     std::cerr<<" "<<"-D, --dep-all - Gets all dependences (list of file paths) for given input."<<std::endl;
     std::cerr<<" "<<"-d, --dep - Gets direct dependences (list of file paths) for given input."<<std::endl;
+    std::cerr<<" "<<"--dep-scan - With -D or -d only 'include' lines are read (faster); syntax errors in other lines are not reported."<<std::endl;
     std::cerr<<" "<<"-s, --strip - Strip output (no new lines are added and comments are ommited)."<<std::endl;
+    std::cerr<<" "<<"--if-changed - Output file is replaced (atomically) only if its content changes."<<std::endl;
+    std::cerr<<"  "<<" Output is rendered in memory first; its memory is reserved once from the output size estimate."<<std::endl;
+    std::cerr<<" "<<"--precompile - Writes precompiled file (binary, all included files linked) instead of HTML; it is used later as input without source files."<<std::endl;
+    std::cerr<<" "<<"--cache-dir=<dir> - Parsed files are stored in given directory and reused by next calls (key: file content and program version)."<<std::endl;
+    std::cerr<<" "<<"--cache-size=<value> - Size limit of cache directory in MB (default: 256, 0 - no limit); least recently used files are removed."<<std::endl;
+    std::cerr<<" "<<"--max-output=<value> - Output size limit in MB (default: 0 - no limit); exact output size is estimated before rendering,"<<std::endl;
+    std::cerr<<"  "<<" so clone fan-out which would exceed the limit is an error before anything is written."<<std::endl;
+    std::cerr<<" "<<"--stats, --stats=json - Writes statistics to error stream: wall and CPU time of phases (read, lex, parse, link, render, estimate, write) for run and files,"<<std::endl;
+    std::cerr<<"  "<<" counts of line objects, include and clone expansions, bytes read, estimated (with --max-output or --if-changed) and written, peak RSS, realpath and access calls."<<std::endl;
+    std::cerr<<" "<<"--profile, --profile=<file> - Writes render profile to error stream: time and output bytes of defines and included files (with nested nodes),"<<std::endl;
+    std::cerr<<"  "<<" files and source lines (own nodes), summed over all expansions; with file also writes collapsed stacks (time in ns) for flamegraph tools."<<std::endl;
+    std::cerr<<" "<<"--profile-top=<value> - Number of items in each profile list (default: 20)."<<std::endl;
+    std::cerr<<" "<<"--trace=<file> - Writes trace (Chrome trace-event JSON, e.g. for chrome://tracing or Perfetto) with spans of file parsing,"<<std::endl;
+    std::cerr<<"  "<<" include directives (parse and render), clone expansions, rendering and output writes; batch jobs are separate tracks."<<std::endl;
+    std::cerr<<" "<<"-MD - Writes make dependences of output during compilation (output with suffix .d)."<<std::endl;
+    std::cerr<<" "<<"-MF file - Writes make dependences of output during compilation to given file."<<std::endl;
     std::cerr<<" "<<"-v, --verbose - Verbose error stream."<<std::endl;
     std::cerr<<" "<<"-<number> value, --<number>=value - Tokens used inside input (replaces $<number> in input)."<<std::endl;
     std::cerr<<" "<<"--max-depth=<value> - Changes max-depth value."<<std::endl;
+    std::cerr<<" "<<"--worker - Persistent worker: reads compile requests from standard input and writes results to standard output."<<std::endl;
+    std::cerr<<"  "<<" Request and result are frames of fields '<name> <length>\\n<value>\\n' closed by field 'end'."<<std::endl;
+    std::cerr<<"  "<<" Request fields: input, output, strip (0 or 1), <number> (token value)."<<std::endl;
+    std::cerr<<"  "<<" Result fields: status (0 on success), dep (one per dependence), log (error stream)."<<std::endl;
+    std::cerr<<" "<<"--serve socket, --serve=socket - Local daemon on a Unix domain socket (parsed files are cached)."<<std::endl;
+    std::cerr<<"  "<<" If DOROTHY_SOCKET variable is set, the call is passed to the daemon (or done locally if the daemon does not answer)."<<std::endl;
+    std::cerr<<" "<<"--workers=<value> - Number of daemon worker processes (default: number of processors)."<<std::endl;
+    std::cerr<<" "<<"--watch - Compiles pairs of input and output, then recompiles outputs whose files change (until interrupted)."<<std::endl;
+    std::cerr<<" "<<"--batch - Compiles pairs of input and output in parallel processes."<<std::endl;
+    std::cerr<<"  "<<" Under make with jobserver (MAKEFLAGS, recipe with '+' or $(MAKE)) jobs share make's job slots."<<std::endl;
+    std::cerr<<" "<<"--jobs=<value> - Max number of parallel batch jobs without make jobserver (default: number of processors)."<<std::endl;
     std::cerr<<" "<<"-h, --help - Prints this help."<<std::endl;
     std::cerr<<" "<<"--version - Prints version."<<std::endl;
     std::cerr<<"Examples:"<<std::endl;
@@ -268,14 +432,105 @@ static int print_usage(options_t & options){
     std::cerr<<" "<<ict::global::arg[0]<<" -d ./inputfile.dorothy - # Shows direct dependences for ./inputfile.dorothy file."<<std::endl;
     std::cerr<<" "<<ict::global::arg[0]<<" --1=One --2=\"Two\" ./inputfile.dorothy ./outputfile.html"<<std::endl;
     std::cerr<<"  "<<" # Creates HTML for ./inputfile.dorothy file using given tokens and writes it in ./outputfile.html ."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" -MD ./inputfile.dorothy ./outputfile.html # Also writes ./outputfile.d for make (-include *.d)."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --precompile ./inputfile.dorothy ./inputfile.dorothyc && "<<ict::global::arg[0]<<" --1=One ./inputfile.dorothyc -"<<std::endl;
+    std::cerr<<"  "<<" # Precompiles ./inputfile.dorothy file and creates HTML from precompiled file."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --stats=json ./inputfile.dorothy ./outputfile.html 2> stats.json # Writes statistics (one JSON object per run)."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --profile=render.folded ./inputfile.dorothy ./outputfile.html && flamegraph.pl render.folded > render.svg"<<std::endl;
+    std::cerr<<"  "<<" # Shows the most expensive defines, includes and lines and draws flame graph of rendering."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --batch --trace=build.json ./a.dorothy ./a.html ./b.dorothy ./b.html # Writes trace of the whole batch."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --cache-dir=$HOME/.cache/dorothy ./inputfile.dorothy ./outputfile.html # Reuses parsed files between calls."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --worker --max-depth=100 # Starts worker (parsed files are cached between requests)."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --batch -MD ./a.dorothy ./a.html ./b.dorothy ./b.html # Compiles ./a.html and ./b.html in parallel."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --watch -s ./a.dorothy ./a.html ./b.dorothy ./b.html # Keeps ./a.html and ./b.html up to date."<<std::endl;
+    std::cerr<<" "<<ict::global::arg[0]<<" --serve /tmp/dorothy.sock & DOROTHY_SOCKET=/tmp/dorothy.sock make # Builds using the daemon."<<std::endl;
     std::cerr<<"Bug reports: "<<PACKAGE_BUGREPORT<<std::endl;
     print_version(options);
     std::cerr<<std::endl;
   }
   return(options.mode?options.out:0);
 }
-static int do_job(options_t & options){
+//! Czas zapisu wyjścia w bieżącym zadaniu (--stats) - otwarcie, porównanie, podmiana i zamknięcie pliku.
+static ict::dorothy::time_stats_t write_time;
+static ict::dorothy::time_stats_t write_start;
+static std::uint64_t wall_clock(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+static void start_write(const options_t & options){
+  ICT_PROBE(dorothy,output_flush_start,options.output.c_str());
+  if (options.trace.size()) ict::dorothy::Interface::traceBegin("write","write "+options.output);
+  if (!options.stats) return;
+  write_start.wall=wall_clock();
+  write_start.cpu=ict::os::getCpuTime();
+}
+static void stop_write(const options_t & options){
+  ICT_PROBE(dorothy,output_flush_end,options.output.c_str());
+  if (options.trace.size()) ict::dorothy::Interface::traceEnd();
+  if (!options.stats) return;
+  write_time.wall+=wall_clock()-write_start.wall;
+  write_time.cpu+=ict::os::getCpuTime()-write_start.cpu;
+}
+//! Liczba kompilacji z --if-changed i liczba pominiętych zapisów (wynik bez zmian) w tym procesie.
+static unsigned int written_count=0;
+static unsigned int skipped_count=0;
+//! Zapis wyjścia tylko po zmianie: wynik w pamięci, porównanie z istniejącym plikiem, atomowa podmiana.
+static int write_if_changed(options_t & options,ict::dorothy::Interface & interface){
+  std::string buffer;
+  int out(interface.serialize(buffer));
+  if (out) return(out);
+  start_write(options);
+  if (ict::os::isFileEqual(options.output,buffer)){
+    stop_write(options);
+    skipped_count++;
+    if (options.verbose>0) std::cerr<<"Output unchanged (skipped "<<skipped_count<<" of "<<(written_count+skipped_count)<<"): "<<options.output<<std::endl;
+    return(0);
+  }
+  if (!ict::os::replaceFile(options.output,buffer)){
+    stop_write(options);
+    std::cerr<<"ERROR(-6): Can not write output "<<options.output<<" !"<<std::endl;
+    return(-6);
+  }
+  stop_write(options);
+  written_count++;
+  if (options.verbose>0) std::cerr<<"Output written (skipped "<<skipped_count<<" of "<<(written_count+skipped_count)<<"): "<<options.output<<std::endl;
+  return(0);
+}
+//! Ścieżka w pliku make (spacje, '#' i '$' poprzedzone znakiem ucieczki).
+static std::string make_path(const std::string & in){
+  std::string out;
+  for (const char c : in) switch (c){
+    case ' ':case '\t':case '#':out+='\\';out+=c;break;
+    case '$':out+="$$";break;
+    default:out+=c;break;
+  }
+  return(out);
+}
+//! Zapisuje plik zależności dla make: wyjście zależy od wszystkich plików, pliki dołączane są celami pustymi (phony).
+static int write_depfile(options_t & options,const std::vector<std::string> & deps){
+  std::ofstream ofs(options.depfilePath,std::ofstream::out);
+  if (!ofs.good()){
+    std::cerr<<"ERROR(-6): Can not write dependences file "<<options.depfilePath<<" !"<<std::endl;
+    return(-6);
+  }
+  ofs<<make_path(options.output)<<":";
+  for (const auto & path : deps) ofs<<" \\\n "<<make_path(ict::os::getRelativePath(path));
+  ofs<<std::endl;
+  {
+    std::set<std::string> inputs;
+    for (const auto & path : options.input) inputs.insert(ict::os::getRealPath(path));
+    for (const auto & path : deps) if (!inputs.count(path)) ofs<<std::endl<<make_path(ict::os::getRelativePath(path))<<":"<<std::endl;
+  }
+  ofs.close();
+  return(ofs.fail()?-6:0);
+}
+static int run_job(options_t & options,std::vector<std::string> * deps){
+  std::vector<std::string> list;
   int out;
+  if ((!deps)&&options.depfile) deps=&list;
+  //Lista zależności jest budowana z obiektów linii, a -vv i więcej opisuje parsowanie - pliki z pamięci podręcznej nie są wtedy używane.
+  ict::dorothy::Interface::setCacheDir(options.cacheDir,std::uint64_t(options.cacheSize)<<20);
+  ict::dorothy::Interface::setMaxOutput(std::uint64_t(options.maxOutput)<<20);
+  ict::dorothy::Interface::setCache(options.cache&&(options.verbose<2)&&((options.mode==compile_strip)||(options.mode==compile_no_strip)));
   ict::dorothy::Interface interface(
     options.mode==compile_strip,
     options.maxDepth,
@@ -285,13 +540,28 @@ static int do_job(options_t & options){
   );
   try {
     for (const std::string & i : options.input) interface.addInput(i);
-    out=interface.parse();
+    if (options.depScan&&((options.mode==direct_dependences)||(options.mode==all_dependences))){
+      out=interface.scan();
+    } else {
+      out=interface.parse();
+    }
     if (out) return(out);
-    if (options.output=="-"){
+    if (deps) interface.dependencesList(*deps);
+    if (options.maxOutput&&((options.mode==compile_strip)||(options.mode==compile_no_strip))){//Limit przed otwarciem (i wyczyszczeniem) pliku wyjściowego.
+      std::uint64_t size;
+      out=interface.estimate(size);
+      if (out) return(out);
+    }
+    if (options.ifChanged&&(options.output!="-")&&((options.mode==compile_strip)||(options.mode==compile_no_strip))){
+      out=write_if_changed(options,interface);
+    } else if (options.output=="-"){
       switch (options.mode){
         case compile_strip:case compile_no_strip:
           out=interface.serialize(std::cout);
           break;
+        case precompile:
+          out=interface.precompile(std::cout);
+          break;
         case direct_dependences:
           out=interface.dependences(std::cout);
           break;
@@ -300,13 +570,21 @@ static int do_job(options_t & options){
           break;
         default:break;
       }
+      start_write(options);
+      std::cout.flush();
+      stop_write(options);
     } else {
-      std::ofstream ofs(options.output,std::ofstream::out);
+      start_write(options);
+      std::ofstream ofs(options.output,std::ofstream::out|std::ofstream::binary);
+      stop_write(options);
       if(ofs.good()){
         switch (options.mode){
           case compile_strip:case compile_no_strip:
             out=interface.serialize(ofs);
             break;
+          case precompile:
+            out=interface.precompile(ofs);
+            break;
           case direct_dependences:
             out=interface.dependences(ofs);
             break;
@@ -319,31 +597,533 @@ static int do_job(options_t & options){
         std::cerr<<"ERROR(-6): Can not write output "<<options.output<<" !"<<std::endl;
         return(-6);
       }
+      start_write(options);
       ofs.close();
+      stop_write(options);
     }
     if (out) return(out);
+    if (options.depfile&&((options.mode==compile_strip)||(options.mode==compile_no_strip)||(options.mode==precompile))) out=write_depfile(options,*deps);
+    if (out) return(out);
   } catch (...){
     return(internal_error(__LINE__));
   }
   return(0);
 }
-static int dorothy(){
-  options_t options;
+//! Napis JSON (cudzysłów, znaki ucieczki dla '"', '\\' i znaków sterujących).
+static std::string json_string(const std::string & in){
+  static const char hex[]="0123456789abcdef";
+  std::string out("\"");
+  for (const char c : in) switch (c){
+    case '"':out+="\\\"";break;
+    case '\\':out+="\\\\";break;
+    default:
+      if ((unsigned char)c<0x20){
+        out+="\\u00";
+        out+=hex[(c>>4)&0xF];
+        out+=hex[c&0xF];
+      } else {
+        out+=c;
+      }
+      break;
+  }
+  out+='"';
+  return(out);
+}
+//! Czas fazy: w JSON pola wall_ns i cpu_ns, w tekście 'ściennym/procesora' w ms.
+static void print_time(std::ostream & output,bool json,const std::string & name,const ict::dorothy::time_stats_t & t){
+  if (json){
+    output<<json_string(name)<<":{\"wall_ns\":"<<t.wall<<",\"cpu_ns\":"<<t.cpu<<"}";
+  } else {
+    output<<" "<<name<<"="<<std::fixed<<std::setprecision(3)<<(t.wall/1e6)<<"/"<<(t.cpu/1e6);
+  }
+}
+//! Statystyki zadania (--stats) na standardowym wyjściu błędów - tekst albo jeden obiekt JSON w jednej linii.
+static void print_stats(const options_t & options,const ict::os::counters_t & counters,int status){
+  const bool json(options.stats==stats_json);
+  const std::uint64_t realpathCalls(ict::os::counters.realpath-counters.realpath);
+  const std::uint64_t accessCalls(ict::os::counters.access-counters.access);
+  const std::uint64_t rss(ict::os::getPeakRss());
+  ict::dorothy::stats_t stats;
+  std::ostringstream output;
+  ict::dorothy::Interface::getStats(stats);
+  if (json){
+    bool first=true;
+    output<<"{\"input\":[";
+    for (const auto & path : options.input) {
+      output<<(first?"":",")<<json_string(path);
+      first=false;
+    }
+    output<<"],\"output\":"<<json_string(options.output)<<",\"status\":"<<status<<",\"phases\":{";
+    print_time(output,json,"read",stats.read);output<<",";
+    print_time(output,json,"lex",stats.lex);output<<",";
+    print_time(output,json,"parse",stats.parse);output<<",";
+    print_time(output,json,"link",stats.link);output<<",";
+    print_time(output,json,"render",stats.render);output<<",";
+    print_time(output,json,"estimate",stats.estimate);output<<",";
+    print_time(output,json,"write",write_time);
+    output<<"},\"files\":[";
+    first=true;
+    for (const auto & f : stats.files){
+      output<<(first?"":",")<<"{\"path\":"<<json_string(ict::os::getRelativePath(f.path))<<",\"bytes\":"<<f.bytes<<",\"lines\":"<<f.lines<<",";
+      print_time(output,json,"read",f.read);output<<",";
+      print_time(output,json,"lex",f.lex);output<<",";
+      print_time(output,json,"parse",f.parse);output<<",";
+      print_time(output,json,"link",f.link);output<<"}";
+      first=false;
+    }
+    output<<"],\"lines\":{";
+    first=true;
+    for (const auto & l : stats.lines) {
+      output<<(first?"":",")<<json_string(l.first)<<":"<<l.second;
+      first=false;
+    }
+    output<<"},\"includes\":"<<stats.includes<<",\"clones\":"<<stats.clones;
+    output<<",\"bytes_read\":"<<stats.bytesRead<<",\"bytes_estimated\":"<<stats.bytesEstimated<<",\"bytes_written\":"<<stats.bytesWritten<<",\"peak_rss_kb\":"<<rss;
+    output<<",\"calls\":{\"realpath\":"<<realpathCalls<<",\"access\":"<<accessCalls<<"}}"<<std::endl;
+  } else {
+    output<<"Stats: input=";
+    for (std::size_t i=0;i<options.input.size();i++) output<<(i?",":"")<<options.input[i];
+    output<<" output="<<options.output<<" status="<<status<<std::endl;
+    output<<" Phases (wall/CPU ms):";
+    print_time(output,json,"read",stats.read);
+    print_time(output,json,"lex",stats.lex);
+    print_time(output,json,"parse",stats.parse);
+    print_time(output,json,"link",stats.link);
+    print_time(output,json,"render",stats.render);
+    print_time(output,json,"estimate",stats.estimate);
+    print_time(output,json,"write",write_time);
+    output<<std::endl;
+    for (const auto & f : stats.files){
+      output<<" File "<<ict::os::getRelativePath(f.path)<<": bytes="<<f.bytes<<" lines="<<f.lines;
+      print_time(output,json,"read",f.read);
+      print_time(output,json,"lex",f.lex);
+      print_time(output,json,"parse",f.parse);
+      print_time(output,json,"link",f.link);
+      output<<std::endl;
+    }
+    output<<" Lines:";
+    for (const auto & l : stats.lines) output<<" "<<l.first<<"="<<l.second;
+    output<<std::endl;
+    output<<" Expansions: include="<<stats.includes<<" clone="<<stats.clones<<std::endl;
+    output<<" Bytes: read="<<stats.bytesRead<<" estimated="<<stats.bytesEstimated<<" written="<<stats.bytesWritten<<std::endl;
+    output<<" Peak RSS: "<<rss<<" kB"<<std::endl;
+    output<<" Calls: realpath="<<realpathCalls<<" access="<<accessCalls<<std::endl;
+  }
+  std::cerr<<output.str();
+}
+//! Profil serializacji zadania (--profile) - raport na standardowym wyjściu błędów i stosy w pliku (gdy podany).
+static int print_profile(const options_t & options){
+  ict::dorothy::Interface::profile(std::cerr,options.profileTop);
+  if (options.profilePath.size()){
+    std::ofstream ofs(options.profilePath);
+    if (ofs.is_open()) ict::dorothy::Interface::profileStacks(ofs);
+    if (!(ofs.is_open()&&ofs.good())){
+      std::cerr<<"ERROR(-6): Can not write profile "<<options.profilePath<<" !"<<std::endl;
+      return(-6);
+    }
+  }
+  return(0);
+}
+//! Początek i koniec pliku śladu (--trace) - zdarzenia są zapisywane między nimi.
+static const char trace_head[]="{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+static const char trace_tail[]="\n]}\n";
+//! Ślad zadania (--trace) - cały plik albo (w zadaniu --batch) plik częściowy z samymi zdarzeniami.
+static int write_trace(const options_t & options){
+  const std::string path(options.tracePart?(options.trace+"."+std::to_string(getpid())):options.trace);
+  std::ofstream ofs(path,std::ofstream::out|std::ofstream::binary);
+  if (ofs.is_open()){
+    if (!options.tracePart) ofs<<trace_head;
+    ict::dorothy::Interface::trace(ofs,getpid(),options.output);
+    if (!options.tracePart) ofs<<trace_tail;
+    ofs.close();
+  }
+  if (ofs.fail()){
+    std::cerr<<"ERROR(-6): Can not write trace "<<path<<" !"<<std::endl;
+    return(-6);
+  }
+  return(0);
+}
+static int do_job(options_t & options,std::vector<std::string> * deps=nullptr){
+  int out;
+  const ict::os::counters_t counters(ict::os::counters);
+  write_time=ict::dorothy::time_stats_t();
+  ict::dorothy::Interface::setStats(options.stats!=stats_none);
+  ict::dorothy::Interface::setProfile(options.profile);
+  ict::dorothy::Interface::setTrace(options.trace.size());
+  ict::dorothy::Interface::traceBegin("job","job "+(options.input.size()?options.input.front():std::string()));
+  out=run_job(options,deps);
+  ict::dorothy::Interface::traceEnd();
+  if (options.stats) print_stats(options,counters,out);
+  if (options.profile) {
+    const int profile(print_profile(options));
+    if (!out) out=profile;
+  }
+  if (options.trace.size()) {
+    const int trace(write_trace(options));
+    if (!out) out=trace;
+  }
+  return(out);
+}
+//! Łączy pliki częściowe śladu zadań --batch (w kolejności uruchomienia) w jeden plik - każde zadanie ma własny wiersz (pid).
+static int merge_trace(const options_t & options,const std::vector<pid_t> & pids){
+  std::ofstream ofs(options.trace,std::ofstream::out|std::ofstream::binary);
+  bool first=true;
+  ofs<<trace_head;
+  for (const pid_t pid : pids){
+    const std::string path(options.trace+"."+std::to_string(pid));
+    std::ifstream ifs(path,std::ifstream::in|std::ifstream::binary);
+    if (ifs.is_open()&&(ifs.peek()!=std::ifstream::traits_type::eof())){
+      if (!first) ofs<<","<<std::endl;
+      ofs<<ifs.rdbuf();
+      first=false;
+    }
+    ifs.close();
+    std::remove(path.c_str());
+  }
+  ofs<<trace_tail;
+  ofs.close();
+  if (ofs.fail()){
+    std::cerr<<"ERROR(-6): Can not write trace "<<options.trace<<" !"<<std::endl;
+    return(-6);
+  }
+  return(0);
+}
+//! Ustawia zlecenie na podstawie pól ramki - 0, gdy pola są poprawne.
+static int read_request(const ict::server::fields_t & frame,options_t & request){
+  for (const auto & f : frame){
+    const std::string & name(f.first);
+    const std::string & value(f.second);
+    if (name=="input"){
+      request.input.push_back(value);
+    } else if (name=="output"){
+      request.output=value;
+    } else if (name=="strip"){
+      request.mode=(value=="1")?compile_strip:compile_no_strip;
+    } else if (is_number(name)){
+      try {
+        unsigned int token=std::stoul(name);
+        if (!request.tokens.set(token,value)) return(token_error(token));
+      } catch (...){
+        return(internal_error(__LINE__));
+      }
+    } else {
+      std::cerr<<"ERROR(-2): Unknown worker request field: "<<name<<std::endl;
+      return(-2);
+    }
+  }
+  return(0);
+}
+//! Tryb --worker: zlecenia kompilacji ze standardowego wejścia, wyniki (z listą zależności) na standardowe wyjście.
+static int do_worker(options_t & options){
+  for (;;){
+    options_t request(options);
+    ict::server::fields_t frame,result;
+    std::vector<std::string> deps;
+    std::ostringstream log;
+    std::streambuf * err(std::cerr.rdbuf(log.rdbuf()));
+    request.mode=compile_no_strip;
+    request.cache=true;
+    request.out=ict::server::readFrame(std::cin,frame);
+    if (request.out==1) {
+      std::cerr.rdbuf(err);
+      return(0);
+    }
+    if (request.out) {
+      std::cerr<<"ERROR(-8): Malformed worker request!"<<std::endl;
+      request.out=-8;
+    }
+    if (!request.out) request.out=read_request(frame,request);
+    if (!request.out) for (const auto & path : request.input) if (path=="-"){
+      std::cerr<<"ERROR(-5): Standard input can not be used by worker!"<<std::endl;
+      request.out=-5;
+    }
+    if ((!request.out)&&(request.output=="-")){
+      std::cerr<<"ERROR(-6): Standard output can not be used by worker!"<<std::endl;
+      request.out=-6;
+    }
+    if (!request.out) request.out=test_options(request);
+    if (!request.out) request.out=do_job(request,&deps);
+    std::cerr.rdbuf(err);
+    result.emplace_back("status",std::to_string(request.out));
+    for (const auto & path : deps) result.emplace_back("dep",ict::os::getRelativePath(path));
+    if (log.str().size()) result.emplace_back("log",log.str());
+    ict::server::writeFrame(std::cout,result);
+    std::cout.flush();
+    if (request.out==-8) return(request.out);//Nie można odnaleźć początku kolejnej ramki.
+  }
+}
+//! Tryb --batch: kompiluje pary (wejście, wyjście) w osobnych procesach (stan modułu dorothy jest statyczny).
+//! Pod make z jobserverem (MAKEFLAGS) każde zadanie poza pierwszym wymaga żetonu, bez jobservera naraz działa najwyżej --jobs zadań.
+static int do_batch(options_t & options){
+  std::deque<options_t> pending;
+  std::map<pid_t,options_t> running;
+  std::map<pid_t,bool> tokens;
+  std::vector<pid_t> started;
+  const ict::global::env_t & env(ict::global::getEnv());
+  ict::global::env_t::const_iterator makeflags(env.find("MAKEFLAGS"));
+  ict::os::Jobserver jobserver((makeflags==env.cend())?"":makeflags->second);
+  unsigned int jobs(options.jobs);
+  int out=0;
+  options.input.push_back(options.output);
+  if ((options.mode!=compile_strip)&&(options.mode!=compile_no_strip)&&(options.mode!=precompile)){
+    std::cerr<<"ERROR(-10): Mode not available in batch!"<<std::endl;
+    return(-10);
+  }
+  if ((!options.input.size())||(options.input.size()%2)){
+    std::cerr<<"ERROR(-4): Input and output pairs are expected!"<<std::endl;
+    return(-4);
+  }
+  if (options.depfilePath.size()&&(options.input.size()>2)){
+    std::cerr<<"ERROR(-4): Dependences file (-MF) is ambiguous in batch (use -MD)!"<<std::endl;
+    return(-4);
+  }
+  if (!jobs) {
+    long n(sysconf(_SC_NPROCESSORS_ONLN));
+    jobs=(n>0)?n:1;
+  }
+  for (std::size_t i=0;i<options.input.size();i+=2){
+    options_t job(options);
+    job.batch=false;
+    job.tracePart=true;
+    job.input.assign(1,options.input[i]);
+    job.output=options.input[i+1];
+    pending.push_back(job);
+  }
+  if (options.verbose>0) std::cerr<<"Batch: "<<pending.size()<<" jobs, "<<(jobserver.good()?"make jobserver":("max "+std::to_string(jobs)+" jobs"))<<std::endl;
+  while (pending.size()||running.size()){
+    bool token=false;
+    if (pending.size()){
+      bool start;
+      if (running.empty()){//Żeton procesu.
+        start=true;
+      } else if (jobserver.good()){
+        start=token=jobserver.acquire();
+      } else {
+        start=(running.size()<jobs);
+      }
+      if (start){
+        pid_t pid;
+        std::cout.flush();
+        std::cerr.flush();
+        pid=fork();
+        if (pid==0){
+          options_t & job(pending.front());
+          job.out=test_options(job);
+          if (!job.out) job.out=do_job(job);
+          std::cout.flush();
+          std::cerr.flush();
+          _exit(job.out?1:0);
+        }
+        if (pid<0){
+          if (token) jobserver.release();
+          if (running.size()) {//Kolejna próba po zakończeniu innego zadania.
+            start=false;
+          } else {
+            std::cerr<<"ERROR(-13): Unable to start job!"<<std::endl;
+            return(-13);
+          }
+        } else {
+          running[pid]=pending.front();
+          tokens[pid]=token;
+          started.push_back(pid);
+          pending.pop_front();
+          continue;
+        }
+      }
+    }
+    {
+      int status;
+      //Czekanie na żeton nie blokuje odbioru zakończonych zadań (ich żetony wracają do make).
+      const bool waiting(pending.size()&&jobserver.good()&&running.size());
+      pid_t pid(waitpid(-1,&status,waiting?WNOHANG:0));
+      if (pid>0){
+        if (running.count(pid)){
+          if (tokens[pid]) jobserver.release();
+          if ((!WIFEXITED(status))||WEXITSTATUS(status)){
+            std::cerr<<"ERROR(-12): Job failed: "<<running[pid].input.front()<<" -> "<<running[pid].output<<std::endl;
+            out=-12;
+          }
+          running.erase(pid);
+          tokens.erase(pid);
+        }
+      } else if (waiting){
+        jobserver.wait(50);
+      } else if (errno!=EINTR){
+        return(internal_error(__LINE__));
+      }
+    }
+  }
+  if (options.trace.size()) {
+    const int trace(merge_trace(options,started));
+    if (!out) out=trace;
+  }
+  return(out);
+}
+//! Tryb --watch: kompiluje pary (wejście, wyjście), a potem ponownie tylko wyjścia zależne od zmienionych plików.
+static int do_watch(options_t & options){
+  struct root_t {options_t job;std::set<std::string> deps;};
+  std::vector<root_t> roots;
+  std::set<std::string> changed;
+  ict::os::Watch watcher;
+  options.input.push_back(options.output);
+  if ((options.mode!=compile_strip)&&(options.mode!=compile_no_strip)){
+    std::cerr<<"ERROR(-10): Mode not available in watch!"<<std::endl;
+    return(-10);
+  }
+  if ((!options.input.size())||(options.input.size()%2)){
+    std::cerr<<"ERROR(-4): Input and output pairs are expected!"<<std::endl;
+    return(-4);
+  }
+  if (!watcher.good()){
+    std::cerr<<"ERROR(-11): Unable to watch files!"<<std::endl;
+    return(-11);
+  }
+  for (std::size_t i=0;i<options.input.size();i+=2){
+    root_t root;
+    root.job=options;
+    root.job.watch=false;
+    root.job.cache=true;
+    root.job.input.assign(1,options.input[i]);
+    root.job.output=options.input[i+1];
+    root.deps.insert(ict::os::getRealPath(options.input[i]));
+    roots.push_back(root);
+  }
+  for (bool first=true;;first=false){
+    for (root_t & root : roots){
+      std::vector<std::string> deps;
+      bool affected=first;
+      for (const auto & path : changed) if (root.deps.count(path)) affected=true;
+      if (!affected) continue;
+      root.job.out=test_options(root.job);
+      if (!root.job.out) root.job.out=do_job(root.job,&deps);
+      //Po błędzie zostaje poprzednia lista zależności (plik jest kompilowany po kolejnej zmianie).
+      for (const auto & path : deps) root.deps.insert(path);
+      for (const auto & path : root.deps) watcher.add(path);
+      std::cerr<<"Watch: "<<root.job.input.front()<<" -> "<<root.job.output;
+      if (root.job.out) std::cerr<<" (error "<<root.job.out<<")";
+      std::cerr<<std::endl;
+    }
+    changed.clear();
+    if (!watcher.wait(changed)){
+      std::cerr<<"ERROR(-11): Unable to watch files!"<<std::endl;
+      return(-11);
+    }
+  }
+}
+//! Wywołanie obsługiwane przez demona (--serve) - tryby --worker i --serve nie są wtedy dostępne.
+static bool served=false;
+static int serve_request(const ict::server::fields_t & request,ict::server::fields_t & response);
+static int dorothy_options(options_t & options){
   //return(ict::os::test());
   options.out=parse_options(options);
   if (options.mode==print_help) return(print_usage(options));
   if (options.mode==print_ver) return(print_version(options));
   if (options.out) return(print_usage(options));
+  if (served&&((options.mode==worker)||(options.mode==serve)||options.watch||options.batch)){
+    std::cerr<<"ERROR(-10): Mode not available in daemon!"<<std::endl;
+    options.out=-10;
+    return(print_usage(options));
+  }
+  if (options.mode==worker) return(do_worker(options));
+  if (options.watch) return(do_watch(options));
+  if (options.batch) {
+    options.out=do_batch(options);
+    return(options.out);
+  }
+  if (options.mode==serve) {
+    if (!options.socket.size()) options.socket=options.output;
+    if (!options.socket.size()){
+      std::cerr<<"ERROR(-4): Socket path is missing!"<<std::endl;
+      options.out=-4;
+      return(print_usage(options));
+    }
+    return(ict::server::serve(options.socket,options.workers,serve_request));
+  }
   options.out=test_options(options);
   if (options.out) return(print_usage(options));
   options.out=do_job(options);
   if (options.out) return(print_usage(options));
   return(0);
 }
+//! Obsługa zlecenia w procesie demona: argumenty i katalog roboczy klienta, wyniki strumieni w odpowiedzi.
+static int serve_request(const ict::server::fields_t & request,ict::server::fields_t & response){
+  options_t options;
+  std::ostringstream out_s,err_s;
+  std::string cwd;
+  served=true;
+  ict::global::arg.clear();
+  for (const auto & f : request){
+    if (f.first=="cwd") cwd=f.second;
+    if (f.first=="arg") ict::global::arg.push_back(f.second);
+  }
+  {
+    std::streambuf * out_b(std::cout.rdbuf(out_s.rdbuf()));
+    std::streambuf * err_b(std::cerr.rdbuf(err_s.rdbuf()));
+    if ((!ict::global::arg.size())||(!ict::os::setCurrentDir(cwd))){
+      std::cerr<<"ERROR(-9): Can not use working dir "<<cwd<<" !"<<std::endl;
+      options.out=-9;
+    } else {
+      options.cache=true;
+      options.out=dorothy_options(options);
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::cout.rdbuf(out_b);
+    std::cerr.rdbuf(err_b);
+  }
+  response.emplace_back("status",std::to_string(options.out));
+  if (out_s.str().size()) response.emplace_back("stdout",out_s.str());
+  if (err_s.str().size()) response.emplace_back("stderr",err_s.str());
+  if ((!options.out)&&((options.mode==compile_strip)||(options.mode==compile_no_strip)||(options.mode==precompile))&&(options.output!="-"))
+    response.emplace_back("output",ict::os::getRealPath(options.output));
+  return(0);
+}
+//! Klient demona: gdy ustawiona jest zmienna DOROTHY_SOCKET, wywołanie jest przekazywane do demona (bez zmian w plikach Makefile).
+//! Zwraca false, gdy wywołanie trzeba obsłużyć lokalnie (brak demona, standardowe wejście, tryby --worker i --serve).
+static bool do_client(int & out){
+  const ict::global::env_t & env(ict::global::getEnv());
+  ict::global::env_t::const_iterator socket(env.find("DOROTHY_SOCKET"));
+  ict::server::fields_t request,response;
+  if ((socket==env.cend())||(!socket->second.size())) return(false);
+  for (std::size_t i=1;i<ict::global::arg.size();i++){
+    const std::string & arg(ict::global::arg[i]);
+    if ((arg=="--worker")||(arg=="--watch")||(arg=="--batch")||(!arg.compare(0,7,"--serve"))) return(false);
+    if ((arg=="-")&&(i+1<ict::global::arg.size())) return(false);
+  }
+  request.emplace_back("cwd",ict::os::getCurrentDir());
+  for (const auto & arg : ict::global::arg) request.emplace_back("arg",arg);
+  if (ict::server::request(socket->second,request,response)) return(false);
+  bool status=false;
+  for (const auto & f : response){
+    if (f.first=="status") {
+      try {
+        out=std::stoi(f.second);
+        status=true;
+      } catch (...){
+      }
+    }
+    if (f.first=="stdout") std::cout<<f.second;
+    if (f.first=="stderr") std::cerr<<f.second;
+  }
+  if (!status) out=internal_error(__LINE__);
+  return(true);
+}
+static int dorothy(){
+  options_t options;
+  int out;
+  if (do_client(out)) return(out);
+  return(dorothy_options(options));
+}
 //============================================
 }}
 //============================================
 int main(int argc, char **argv){
-  return(ict::global::main(argc,argv,ict::main::dorothy));
+  int out;
+  //Tylko strumienie C++ - bez synchronizacji z stdio.
+  std::ios_base::sync_with_stdio(false);
+  out=ict::global::main(argc,argv,ict::main::dorothy);
+  //Kody błędów (np. numery linii) nie mogą zostać obcięte do 0 przez status procesu.
+  if (out&&!(out&0xFF)) return(1);
+  return(out);
 }
 //===========================================
\ No newline at end of file
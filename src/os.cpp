@@ -37,6 +37,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os.hpp"
 #include "global.hpp"
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
 #include <stdlib.h>
 #include <iostream>
 //============================================
@@ -47,6 +61,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //============================================
 namespace ict { namespace os {
 //===========================================
+counters_t counters={0,0};
 std::string getCurrentDir(){
   std::string out;
   char *path=getcwd(NULL,0);
@@ -57,6 +72,9 @@ std::string getCurrentDir(){
   if (out.back()!='/') out+='/';
   return(out);
 }
+bool setCurrentDir(const std::string & path){
+  return(chdir(path.c_str())==0);
+}
 std::string getOnlyDir(const std::string & path){
   std::string out(path);
   std::size_t p;
@@ -71,6 +89,7 @@ std::string getOnlyDir(const std::string & path){
 }
 bool isFileReadable(const std::string & base,const std::string & path){
   if (path=="-") return(true);
+  counters.access++;
   return(access(getRealPath(base,path).c_str(),R_OK)==0);
 }
 bool isFileReadable(const std::string & path){
@@ -80,7 +99,9 @@ std::string getRealPath(const std::string & path){
   std::string out(path);
   if (path=="-") return(getRealPath(path));
   {
-    char *full_path=realpath(path.c_str(),NULL);
+    char *full_path;
+    counters.realpath++;
+    full_path=realpath(path.c_str(),NULL);
     if (full_path) {
       out=full_path;
       free(full_path);
@@ -95,6 +116,16 @@ std::string getRealPath(const std::string & base,const std::string & path){
   if (path.front()=='/') return(getRealPath(path));
   return(getRealPath(getOnlyDir(base)+path));
 }
+std::uint64_t getCpuTime(){
+  struct timespec t;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&t)) return(0);
+  return(std::uint64_t(t.tv_sec)*1000000000+t.tv_nsec);
+}
+std::uint64_t getPeakRss(){
+  struct rusage u;
+  if (getrusage(RUSAGE_SELF,&u)) return(0);
+  return(u.ru_maxrss);
+}
 std::string getRelativePath(const std::string & base,const std::string & path){
   std::string out("./");
   std::size_t i=0;
@@ -120,6 +151,238 @@ std::string getRelativePath(const std::string & base,const std::string & path){
 std::string getRelativePath(const std::string & path){
   return(getRelativePath("-",path));
 }
+bool getFileStamp(const std::string & path,std::int64_t & mtime,std::int64_t & size){
+  struct stat s;
+  if (path=="-") return(false);
+  if (stat(path.c_str(),&s)) return(false);
+  mtime=std::int64_t(s.st_mtim.tv_sec)*1000000000+s.st_mtim.tv_nsec;
+  size=s.st_size;
+  return(true);
+}
+bool isFileEqual(const std::string & path,const std::string & content){
+  char buffer[0x10000];
+  struct stat s;
+  std::size_t i=0;
+  int fd;
+  if (stat(path.c_str(),&s)||(!S_ISREG(s.st_mode))||(std::size_t(s.st_size)!=content.size())) return(false);
+  fd=open(path.c_str(),O_RDONLY|O_CLOEXEC);
+  if (fd<0) return(false);
+  for (;;){
+    ssize_t r(read(fd,buffer,sizeof(buffer)));
+    if ((r<0)&&(errno==EINTR)) continue;
+    if (r<=0) break;
+    if (((i+r)>content.size())||std::memcmp(buffer,content.data()+i,r)) {
+      close(fd);
+      return(false);
+    }
+    i+=r;
+  }
+  close(fd);
+  return(i==content.size());
+}
+bool replaceFile(const std::string & path,const std::string & content){
+  std::string tmp(path+".XXXXXX");
+  struct stat s;
+  mode_t mode;
+  int fd;
+  if (!stat(path.c_str(),&s)){
+    mode=s.st_mode&07777;
+  } else {
+    mode_t mask(umask(0));
+    umask(mask);
+    mode=0666&~mask;
+  }
+  fd=mkstemp(&tmp[0]);
+  if (fd<0) return(false);
+  for (std::size_t i=0;i<content.size();){
+    ssize_t w(write(fd,content.data()+i,content.size()-i));
+    if ((w<0)&&(errno==EINTR)) continue;
+    if (w<0) {
+      close(fd);
+      unlink(tmp.c_str());
+      return(false);
+    }
+    i+=w;
+  }
+  {
+    bool ok(!fchmod(fd,mode));
+    if (close(fd)) ok=false;
+    if (ok&&rename(tmp.c_str(),path.c_str())) ok=false;
+    if (!ok) unlink(tmp.c_str());
+    return(ok);
+  }
+}
+std::shared_ptr<const char> mapFile(const std::string & path,std::size_t & size){
+  struct stat st;
+  void * p;
+  int fd(open(path.c_str(),O_RDONLY|O_CLOEXEC));
+  if (fd<0) return(nullptr);
+  if (fstat(fd,&st)||(st.st_size<=0)) {
+    close(fd);
+    return(nullptr);
+  }
+  size=st.st_size;
+  p=mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (p==MAP_FAILED) return(nullptr);
+  return(std::shared_ptr<const char>((const char*)p,[size](const char * q){munmap((void*)q,size);}));
+}
+bool makeDir(const std::string & path){
+  return((mkdir(path.c_str(),0777)==0)||(errno==EEXIST));
+}
+bool touchFile(const std::string & path){
+  return(utimensat(AT_FDCWD,path.c_str(),nullptr,0)==0);
+}
+void trimDir(const std::string & dir,const std::string & suffix,std::uint64_t maxSize,std::uint64_t added){
+  struct file_t {std::int64_t mtime;std::uint64_t size;std::string path;};
+  std::vector<file_t> files;
+  std::uint64_t total=0,written=0;
+  std::string base(dir);
+  DIR * d;
+  int lock;
+  if (base.size()&&(base.back()!='/')) base+='/';
+  lock=open((base+".lock").c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0666);
+  if (lock<0) return;
+  //Licznik bajtów zapisanych od ostatniego porządkowania (wspólny dla procesów) - krótka blokada tylko na czas aktualizacji.
+  if (flock(lock,LOCK_EX)) {
+    close(lock);
+    return;
+  }
+  if (pread(lock,&written,sizeof(written),0)!=sizeof(written)) written=0;
+  written+=added;
+  if (written<(maxSize/4)) {
+    if (pwrite(lock,&written,sizeof(written),0)!=sizeof(written)) {}
+    flock(lock,LOCK_UN);
+    close(lock);
+    return;
+  }
+  written=0;//Ten proces porządkuje katalog, pozostałe liczą od zera.
+  if (pwrite(lock,&written,sizeof(written),0)!=sizeof(written)) {}
+  flock(lock,LOCK_UN);
+  close(lock);
+  d=opendir(dir.c_str());
+  if (d) {
+    for (dirent * e=readdir(d);e;e=readdir(d)){
+      std::string name(e->d_name);
+      std::int64_t mtime,size;
+      if ((name.size()<=suffix.size())||name.compare(name.size()-suffix.size(),suffix.size(),suffix)) continue;
+      if (!getFileStamp(base+name,mtime,size)) continue;
+      files.push_back({mtime,std::uint64_t(size),base+name});
+      total+=size;
+    }
+    closedir(d);
+  }
+  if (total>maxSize){
+    std::sort(files.begin(),files.end(),[](const file_t & a,const file_t & b){return(a.mtime<b.mtime);});
+    for (const file_t & f : files) {
+      if (total<=(maxSize/4*3)) break;
+      if (!unlink(f.path.c_str())) total-=f.size;
+    }
+  }
+}
+Watch::Watch():fd(inotify_init1(IN_CLOEXEC)){
+}
+Watch::~Watch(){
+  if (fd>=0) close(fd);
+}
+bool Watch::add(const std::string & path){
+  std::string dir(getOnlyDir(path));
+  int wd;
+  if (fd<0) return(false);
+  for (const auto & d : dirs) if (d.second==dir) return(true);
+  wd=inotify_add_watch(fd,dir.c_str(),IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_ATTRIB);
+  if (wd<0) return(false);
+  dirs[wd]=dir;
+  return(true);
+}
+bool Watch::wait(std::set<std::string> & changed,int delay){
+  alignas(inotify_event) char buffer[0x10000];
+  pollfd p={fd,POLLIN,0};
+  if (fd<0) return(false);
+  for (int timeout=-1;;timeout=delay){
+    int r(poll(&p,1,timeout));
+    if (r<0) {
+      if (errno==EINTR) continue;
+      return(false);
+    }
+    if (!r) return(true);//Brak kolejnych zmian.
+    ssize_t s(read(fd,buffer,sizeof(buffer)));
+    if (s<0) {
+      if (errno==EINTR) continue;
+      return(false);
+    }
+    for (ssize_t i=0;i<s;){
+      const inotify_event * e((const inotify_event *)(buffer+i));
+      if (e->len&&dirs.count(e->wd)) changed.insert(dirs.at(e->wd)+e->name);
+      i+=sizeof(inotify_event)+e->len;
+    }
+  }
+}
+//! Otwiera koniec potoku jobservera - w trybie nieblokującym, na własnym opisie pliku (make używa potoku w trybie blokującym).
+static int openJobserver(const std::string & path,int flags){
+  struct stat st;
+  int fd(open(path.c_str(),flags|O_CLOEXEC));
+  if (fd<0) return(-1);
+  if (fstat(fd,&st)||!S_ISFIFO(st.st_mode)) {
+    close(fd);
+    return(-1);
+  }
+  return(fd);
+}
+Jobserver::Jobserver(const std::string & makeflags):readFd(-1),writeFd(-1){
+  static const std::string s_auth("--jobserver-auth=");
+  static const std::string s_fds("--jobserver-fds=");
+  static const std::string s_fifo("fifo:");
+  std::string auth;
+  std::size_t b(0);
+  while (b<makeflags.size()){//Ostatnie wystąpienie wygrywa (jak w make).
+    std::size_t e(makeflags.find(' ',b));
+    const std::string word(makeflags.substr(b,(e==std::string::npos)?e:(e-b)));
+    if (!word.compare(0,s_auth.size(),s_auth)) auth=word.substr(s_auth.size());
+    if (!word.compare(0,s_fds.size(),s_fds)) auth=word.substr(s_fds.size());
+    if (word=="--") break;//Dalej są zmienne z wiersza poleceń.
+    b=(e==std::string::npos)?e:(e+1);
+  }
+  if (!auth.compare(0,s_fifo.size(),s_fifo)) {
+    const std::string path(auth.substr(s_fifo.size()));
+    readFd=openJobserver(path,O_RDONLY|O_NONBLOCK);
+    if (readFd>=0) writeFd=openJobserver(path,O_WRONLY);
+  } else if (auth.size()) {
+    int r,w;
+    char c;
+    //Deskryptory są ważne tylko, gdy make uznał polecenie za rekurencyjne ('+' lub $(MAKE)) - inaczej są zamknięte albo użyte przez inne pliki.
+    if ((std::sscanf(auth.c_str(),"%d,%d%c",&r,&w,&c)==2)&&(r>=0)&&(w>=0)&&(fcntl(r,F_GETFD)>=0)&&(fcntl(w,F_GETFD)>=0)) {
+      readFd=openJobserver("/proc/self/fd/"+std::to_string(r),O_RDONLY|O_NONBLOCK);
+      if (readFd>=0) writeFd=openJobserver("/proc/self/fd/"+std::to_string(w),O_WRONLY);
+    }
+  }
+  if ((readFd>=0)&&(writeFd<0)) {
+    close(readFd);
+    readFd=-1;
+  }
+}
+Jobserver::~Jobserver(){
+  while (tokens.size()) release();
+  if (readFd>=0) close(readFd);
+  if (writeFd>=0) close(writeFd);
+}
+bool Jobserver::acquire(){
+  char c;
+  if (readFd<0) return(false);
+  if (read(readFd,&c,1)!=1) return(false);
+  tokens+=c;
+  return(true);
+}
+void Jobserver::release(){
+  if (!tokens.size()) return;
+  while ((write(writeFd,&tokens.back(),1)<0)&&(errno==EINTR));
+  tokens.pop_back();
+}
+void Jobserver::wait(int delay){
+  pollfd p={readFd,POLLIN,0};
+  if (readFd<0) return;
+  poll(&p,1,delay);
+}
 int test(){
   #define PRINT_TEST(t) std::cout<<#t "="<<t<<std::endl;
   PRINT_TEST(getCurrentDir())
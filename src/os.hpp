@@ -37,10 +37,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define _OS_HEADER
 //============================================
 #include <string>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <memory>
+#include "config.h"
+//============================================
+//! Statyczny punkt śledzenia USDT (provider, nazwa, argumenty) dla bpftrace i perf - tylko z ./configure --enable-usdt (sys/sdt.h).
+//! Bez tej opcji makro to pusta instrukcja (argumenty nie są obliczane), z nią punkt to jedna instrukcja 'nop', dopóki nie jest używany.
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#define ICT_PROBE(provider,...) STAP_PROBEV(provider,__VA_ARGS__)
+#else
+#define ICT_PROBE(provider,...) do{}while(0)
+#endif
 //============================================
 namespace ict { namespace os {
 //===========================================
 std::string getCurrentDir();
+bool setCurrentDir(const std::string & path);
 std::string getOnlyDir(const std::string & path);
 bool isFileReadable(const std::string & base,const std::string & path);
 bool isFileReadable(const std::string & path);
@@ -48,6 +63,63 @@ std::string getRealPath(const std::string & base,const std::string & path);
 std::string getRealPath(const std::string & path);
 std::string getRelativePath(const std::string & base,const std::string & path);
 std::string getRelativePath(const std::string & path);
+//! Liczniki wywołań systemowych dla ścieżek (realpath, access) - statystyki (--stats).
+struct counters_t {std::uint64_t realpath;std::uint64_t access;};
+extern counters_t counters;
+//! Czas procesora zużyty przez proces (ns).
+std::uint64_t getCpuTime();
+//! Największe zużycie pamięci (RSS) przez proces w kB.
+std::uint64_t getPeakRss();
+//! Czas modyfikacji (ns) i rozmiar pliku - false, jeśli plik nie istnieje.
+bool getFileStamp(const std::string & path,std::int64_t & mtime,std::int64_t & size);
+//! Sprawdza, czy plik ma dokładnie podaną zawartość (najpierw rozmiar, potem porównanie w blokach).
+bool isFileEqual(const std::string & path,const std::string & content);
+//! Zapisuje plik atomowo (plik tymczasowy w tym samym katalogu i zmiana nazwy), uprawnienia istniejącego pliku są zachowane.
+bool replaceFile(const std::string & path,const std::string & content);
+//! Mapuje plik do pamięci tylko do odczytu (nullptr - błąd), mapowanie jest zwalniane razem z ostatnią kopią wskaźnika.
+std::shared_ptr<const char> mapFile(const std::string & path,std::size_t & size);
+//! Tworzy katalog (true również, gdy już istnieje).
+bool makeDir(const std::string & path);
+//! Ustawia czas modyfikacji pliku na bieżący (kolejność LRU w pamięci podręcznej).
+bool touchFile(const std::string & path);
+//! Usuwa najstarsze (mtime) pliki z końcówką 'suffix', gdy razem przekraczają 'maxSize' bajtów (do 3/4 limitu).
+//! Plik '.lock' przechowuje liczbę bajtów ('added') zapisanych przez wszystkie procesy od ostatniego porządkowania.
+//! Katalog jest czytany dopiero, gdy licznik osiągnie 1/4 limitu - wtedy porządkuje go jeden proces, a licznik jest zerowany.
+void trimDir(const std::string & dir,const std::string & suffix,std::uint64_t maxSize,std::uint64_t added);
+//! Obserwacja zmian plików (inotify). Obserwowane są katalogi plików, więc zapis przez zmianę nazwy (edytory) też jest widoczny.
+class Watch {
+private:
+  int fd;
+  std::map<int,std::string> dirs;
+public:
+  Watch();
+  ~Watch();
+  bool good() const {return(fd>=0);}
+  //! Dodaje katalog pliku (pełna ścieżka) do obserwowanych.
+  bool add(const std::string & path);
+  //! Czeka na zmiany i zbiera je przez 'delay' ms od ostatniej zmiany (wiele zapisów to jedna zmiana) - pełne ścieżki zmienionych plików.
+  bool wait(std::set<std::string> & changed,int delay=50);
+};
+//! Klient jobservera GNU make (MAKEFLAGS) - żetony pozwalają uruchamiać kolejne zadania razem z zadaniami make bez przeciążania maszyny.
+//! Pierwsze zadanie nie wymaga żetonu (żeton przydzielony przez make samemu procesowi).
+class Jobserver {
+private:
+  int readFd;
+  int writeFd;
+  //! Pobrane żetony (zwracane są te same bajty).
+  std::string tokens;
+public:
+  //! Czyta '--jobserver-auth=R,W', '--jobserver-auth=fifo:ścieżka' lub '--jobserver-fds=R,W' (starsze wersje make).
+  Jobserver(const std::string & makeflags);
+  ~Jobserver();
+  bool good() const {return(readFd>=0);}
+  //! Pobiera żeton bez czekania (false - brak wolnego żetonu).
+  bool acquire();
+  //! Zwraca jeden pobrany żeton.
+  void release();
+  //! Czeka najwyżej 'delay' ms na wolny żeton.
+  void wait(int delay);
+};
 int test();
 //============================================
 }}
@@ -0,0 +1,252 @@
+//! @file
+//! @brief Server module - Source file.
+//! @author Mariusz Ornowski (mariusz.ornowski@ict-project.pl)
+//! @version 1.0
+//! @date 2016
+//! @copyright ICT-Project Mariusz Ornowski (ict-project.pl)
+/* **************************************************************
+Copyright (c) 2016, ICT-Project Mariusz Ornowski (ict-project.pl)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. Neither the name of the ICT-Project Mariusz Ornowski nor the names
+of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**************************************************************/
+//============================================
+#include "server.hpp"
+#include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+//============================================
+//target 
+//ldflags 
+//cppflags -std=c++11 
+//include 
+//============================================
+namespace ict { namespace server {
+//===========================================
+bool readField(std::istream & input,std::string & name,std::string & value){
+  std::string header;
+  std::size_t space;
+  std::size_t size=0;
+  if (!std::getline(input,header)) return(false);
+  space=header.find(' ');
+  if ((space==std::string::npos)||(space+1==header.size())) return(false);
+  for (std::size_t i=space+1;i<header.size();i++){
+    if ((header[i]<'0')||('9'<header[i])) return(false);
+    if (size>(header.max_size()/10)) return(false);
+    size=size*10+(header[i]-'0');
+  }
+  name.assign(header,0,space);
+  try {
+    value.resize(size);
+  } catch (...){
+    return(false);
+  }
+  if (size) {
+    input.read(&value[0],size);
+    if (input.gcount()!=std::streamsize(size)) return(false);
+  }
+  return(input.get()=='\n');
+}
+void writeField(std::ostream & output,const std::string & name,const std::string & value){
+  output<<name<<" "<<value.size()<<"\n"<<value<<"\n";
+}
+int readFrame(std::istream & input,fields_t & frame){
+  std::string name,value;
+  for (bool first=true;;first=false){
+    if (!readField(input,name,value)) return((first&&input.eof()&&!name.size())?1:-1);
+    if (name=="end") return(0);
+    frame.emplace_back(name,value);
+    name.clear();
+  }
+}
+void writeFrame(std::ostream & output,const fields_t & frame){
+  for (const auto & f : frame) writeField(output,f.first,f.second);
+  writeField(output,"end","");
+}
+//===========================================
+static volatile sig_atomic_t stopping=0;
+static void stop(int){
+  stopping=1;
+}
+static bool setAddress(const std::string & path,sockaddr_un & address){
+  std::memset(&address,0,sizeof(address));
+  address.sun_family=AF_UNIX;
+  if (path.size()>=sizeof(address.sun_path)) return(false);
+  std::memcpy(address.sun_path,path.c_str(),path.size());
+  return(true);
+}
+static bool readAll(int fd,std::string & data){
+  char buffer[0x10000];
+  for (;;){
+    ssize_t s=read(fd,buffer,sizeof(buffer));
+    if (s<0) {
+      if (errno==EINTR) continue;
+      return(false);
+    }
+    if (!s) return(true);
+    data.append(buffer,s);
+  }
+}
+static bool writeAll(int fd,const std::string & data){
+  for (std::size_t i=0;i<data.size();){
+    ssize_t s=write(fd,data.data()+i,data.size()-i);
+    if (s<0) {
+      if (errno==EINTR) continue;
+      return(false);
+    }
+    i+=s;
+  }
+  return(true);
+}
+static void work(int fd,handler_t handler){
+  for (;;){
+    std::string data;
+    int c=accept(fd,nullptr,nullptr);
+    if (c<0) {
+      if (errno==EINTR) continue;
+      return;
+    }
+    if (readAll(c,data)){
+      std::istringstream input(data);
+      std::ostringstream output;
+      fields_t request,response;
+      if (readFrame(input,request)){
+        response.emplace_back("status","-8");
+        response.emplace_back("stderr","ERROR(-8): Malformed request!\n");
+      } else {
+        handler(request,response);
+      }
+      writeFrame(output,response);
+      writeAll(c,output.str());
+    }
+    close(c);
+  }
+}
+int serve(const std::string & path,unsigned int workers,handler_t handler){
+  sockaddr_un address;
+  std::vector<pid_t> pool;
+  int fd;
+  if (!setAddress(path,address)){
+    std::cerr<<"ERROR: Socket path is too long: "<<path<<" !"<<std::endl;
+    return(__LINE__);
+  }
+  fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if (fd<0){
+    std::cerr<<"ERROR: Unable to create socket ("<<std::strerror(errno)<<") !"<<std::endl;
+    return(__LINE__);
+  }
+  if (!connect(fd,(sockaddr *)&address,sizeof(address))){
+    std::cerr<<"ERROR: Socket "<<path<<" is already served !"<<std::endl;
+    close(fd);
+    return(__LINE__);
+  }
+  unlink(path.c_str());//Gniazdo po poprzednim demonie.
+  {
+    mode_t mask(umask(0077));//Gniazdo dostępne tylko dla właściciela.
+    int b(bind(fd,(sockaddr *)&address,sizeof(address)));
+    umask(mask);
+    if (b||listen(fd,SOMAXCONN)){
+      std::cerr<<"ERROR: Unable to listen on socket "<<path<<" ("<<std::strerror(errno)<<") !"<<std::endl;
+      close(fd);
+      return(__LINE__);
+    }
+  }
+  {
+    struct sigaction action;
+    std::memset(&action,0,sizeof(action));
+    action.sa_handler=stop;//Bez SA_RESTART - waitpid() jest przerywane.
+    sigaction(SIGINT,&action,nullptr);
+    sigaction(SIGTERM,&action,nullptr);
+    signal(SIGPIPE,SIG_IGN);
+  }
+  if (!workers) {
+    long n(sysconf(_SC_NPROCESSORS_ONLN));
+    workers=(n>0)?n:1;
+  }
+  pool.resize(workers,0);
+  while (!stopping){
+    for (pid_t & p : pool) if (!p) {
+      std::cout.flush();
+      std::cerr.flush();
+      p=fork();
+      if (!p) {
+        signal(SIGINT,SIG_DFL);
+        signal(SIGTERM,SIG_DFL);
+        work(fd,handler);
+        _exit(1);
+      }
+      if (p<0) {
+        std::cerr<<"ERROR: Unable to start worker process ("<<std::strerror(errno)<<") !"<<std::endl;
+        p=0;
+        stopping=1;
+        break;
+      }
+    }
+    if (!stopping) {
+      pid_t w(waitpid(-1,nullptr,0));
+      if (w>0) for (pid_t & p : pool) if (p==w) p=0;//Proces zostanie uruchomiony ponownie.
+    }
+  }
+  for (pid_t p : pool) if (p) kill(p,SIGTERM);
+  for (pid_t p : pool) if (p) waitpid(p,nullptr,0);
+  close(fd);
+  unlink(path.c_str());
+  return(0);
+}
+int request(const std::string & path,const fields_t & request,fields_t & response){
+  sockaddr_un address;
+  std::ostringstream output;
+  std::string data;
+  int fd;
+  if (!setAddress(path,address)) return(__LINE__);
+  fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if (fd<0) return(__LINE__);
+  if (connect(fd,(sockaddr *)&address,sizeof(address))){
+    close(fd);
+    return(__LINE__);
+  }
+  signal(SIGPIPE,SIG_IGN);
+  writeFrame(output,request);
+  if ((!writeAll(fd,output.str()))||shutdown(fd,SHUT_WR)||(!readAll(fd,data))){
+    close(fd);
+    return(__LINE__);
+  }
+  close(fd);
+  {
+    std::istringstream input(data);
+    if (readFrame(input,response)) return(__LINE__);
+  }
+  return(0);
+}
+//============================================
+}}
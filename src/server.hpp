@@ -0,0 +1,106 @@
+//! @file
+//! @brief Server module - header file.
+//! @author Mariusz Ornowski (mariusz.ornowski@ict-project.pl)
+//! @version 1.0
+//! @date 2016
+//! @copyright ICT-Project Mariusz Ornowski (ict-project.pl)
+/* **************************************************************
+Copyright (c) 2016, ICT-Project Mariusz Ornowski (ict-project.pl)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. Neither the name of the ICT-Project Mariusz Ornowski nor the names
+of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**************************************************************/
+#ifndef _SERVER_HEADER
+#define _SERVER_HEADER
+//============================================
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+//============================================
+namespace ict { namespace server {
+//===========================================
+//! Ramka - lista pól (nazwa, wartość), nazwy mogą się powtarzać.
+typedef std::vector<std::pair<std::string,std::string>> fields_t;
+//! Obsługa jednego zlecenia (wywoływana w procesie z puli).
+typedef int (*handler_t)(const fields_t & request,fields_t & response);
+//! 
+//! @brief Czyta jedno pole ramki: '<nazwa> <długość>\n<wartość>\n'.
+//!
+//! @param input Strumień wejściowy.
+//! @param name Nazwa pola.
+//! @param value Wartość pola.
+//! @return Informacja, czy pole jest poprawne.
+//!
+bool readField(std::istream & input,std::string & name,std::string & value);
+//! 
+//! @brief Zapisuje jedno pole ramki.
+//!
+//! @param output Strumień wyjściowy.
+//! @param name Nazwa pola.
+//! @param value Wartość pola.
+//!
+void writeField(std::ostream & output,const std::string & name,const std::string & value);
+//! 
+//! @brief Czyta ramkę (pola aż do pola 'end').
+//!
+//! @param input Strumień wejściowy.
+//! @param frame Pola ramki (bez pola 'end').
+//! @return 0 - ramka poprawna, 1 - koniec strumienia przed ramką, -1 - ramka niepoprawna.
+//!
+int readFrame(std::istream & input,fields_t & frame);
+//! 
+//! @brief Zapisuje ramkę (i pole 'end').
+//!
+//! @param output Strumień wyjściowy.
+//! @param frame Pola ramki.
+//!
+void writeFrame(std::ostream & output,const fields_t & frame);
+//! 
+//! @brief Uruchamia demona na gnieździe Unix (bez nasłuchu sieciowego) z pulą procesów obsługujących zlecenia.
+//!
+//! Każdy proces z puli obsługuje zlecenia po kolei i ma własny stan (pamięć podręczna, katalog roboczy, strumienie).
+//! Działa do sygnału SIGINT lub SIGTERM, potem usuwa gniazdo.
+//!
+//! @param path Ścieżka gniazda.
+//! @param workers Liczba procesów w puli (0 - liczba procesorów).
+//! @param handler Obsługa jednego zlecenia.
+//! @return Kod błędu (0 - poprawne zakończenie).
+//!
+int serve(const std::string & path,unsigned int workers,handler_t handler);
+//! 
+//! @brief Wysyła zlecenie do demona i czeka na odpowiedź.
+//!
+//! @param path Ścieżka gniazda.
+//! @param request Zlecenie.
+//! @param response Odpowiedź.
+//! @return Kod błędu (0 - odpowiedź odebrana), bez komunikatów - wywołujący może wykonać zlecenie sam.
+//!
+int request(const std::string & path,const fields_t & request,fields_t & response);
+//============================================
+}}
+//===========================================
+#endif